@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// the explicit SIMD kernels need x86 and the GCC/Clang target attributes;
+// elsewhere only the scalar kernel is built
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GEMM_X86_SIMD 1
+#include <immintrin.h>
+#include <cstring>
+#endif
+
+// ----------------------------------------------------------------------------
+// Micro-kernels of the packed GEMM engine (see matmul_parallel_gemm)
+// A micro-kernel computes C[0:mr, 0:nr] += Ap * Bp for one MR x NR register
+// tile from a packed MR-row sliver of A and NR-column sliver of B. There is
+// a scalar kernel for every element type and AVX2 and AVX-512 kernels for
+// int, float and int8 (accumulated in int32); the kernel is picked once at
+// startup from cpuid, so one binary uses the widest vectors of whatever
+// machine it runs on.
+// ----------------------------------------------------------------------------
+
+struct GemmBlocking {
+  static constexpr size_t MR = 6;    // rows of the register tile
+  static constexpr size_t NR = 16;   // columns of the register tile
+  size_t mc = 96;                    // rows of a macro-tile (multiple of MR)
+  size_t kc = 256;                   // depth of a packed slice
+  size_t nc = 512;                   // columns of a macro-tile (multiple of NR)
+};
+
+// instruction sets a micro-kernel may use, from narrow to wide
+enum class Isa {
+  SCALAR,
+  AVX2,         // with FMA
+  AVX512,       // AVX-512F and BW
+  AVX512_VNNI   // AVX-512 with the VNNI dot products
+};
+
+// the type products of In are summed in: int8 in int32, others in In
+template <typename In>
+struct Accumulator {
+  using type = In;
+};
+
+template <>
+struct Accumulator<int8_t> {
+  using type = int32_t;
+};
+
+template <typename In>
+using accumulator_t = typename Accumulator<In>::type;
+
+// how the engine packs In: int8 is widened to int16 with every KG = 2
+// consecutive k interleaved, so that a SIMD kernel multiplies and adds a
+// pair in one instruction (pmaddwd, or vpdpwssd with VNNI); the matrices
+// themselves stay int8, a quarter of the memory traffic of int32. Other
+// types are packed as they are, one k at a time.
+template <typename In>
+struct GemmPacking {
+  using type = In;
+  static constexpr size_t KG = 1;
+};
+
+template <>
+struct GemmPacking<int8_t> {
+  using type = int16_t;
+  static constexpr size_t KG = 2;
+};
+
+template <typename In>
+using gemm_packed_t = typename GemmPacking<In>::type;
+
+// kc is a multiple of the packing's KG
+template <typename P, typename Out>
+using GemmMicroKernel = void (*)(size_t kc, const P* Ap, const P* Bp, Out* C, size_t ldc,
+                                 size_t mr, size_t nr);
+
+// the widest instruction set of the running cpu, read from cpuid once
+inline Isa detect_isa() {
+#ifdef GEMM_X86_SIMD
+  static const Isa isa = [](){
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+      return __builtin_cpu_supports("avx512vnni") ? Isa::AVX512_VNNI : Isa::AVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return Isa::AVX2;
+    }
+    return Isa::SCALAR;
+  }();
+  return isa;
+#else
+  return Isa::SCALAR;
+#endif
+}
+
+inline const char* to_string(Isa isa) {
+  switch(isa) {
+    case Isa::AVX512_VNNI: return "avx512_vnni";
+    case Isa::AVX512: return "avx512";
+    case Isa::AVX2:   return "avx2";
+    default:          return "scalar";
+  }
+}
+
+// the accumulators are a fixed-size local array and both loops are fully
+// unrolled, so the compiler keeps them in registers (vectorized as far as
+// the build's -m flags allow), and the padded packs need no edge cases in
+// the inner loop
+template <typename P, typename Acc, typename Out, size_t KG>
+void gemm_micro_kernel_scalar(
+  size_t kc, const P* Ap, const P* Bp, Out* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  Acc acc[MR][NR] = {};
+  for (size_t p = 0; p < kc; p += KG) {
+#pragma GCC unroll 6
+    for (size_t i = 0; i < MR; ++i) {
+#pragma GCC unroll 16
+      for (size_t j = 0; j < NR; ++j) {
+        for (size_t q = 0; q < KG; ++q) {
+          acc[i][j] += static_cast<Acc>(Ap[p*MR + i*KG + q]) * static_cast<Acc>(Bp[p*NR + j*KG + q]);
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < mr; ++i) {
+    for (size_t j = 0; j < nr; ++j) {
+      C[i*ldc + j] += acc[i][j];
+    }
+  }
+}
+
+#ifdef GEMM_X86_SIMD
+
+// add an MR x NR tile of accumulators spilled to tmp to the mr x nr corner
+// of C (edge tiles only)
+template <typename T>
+void gemm_add_tile(const T* tmp, T* C, size_t ldc, size_t mr, size_t nr) {
+  for (size_t i = 0; i < mr; ++i) {
+    for (size_t j = 0; j < nr; ++j) {
+      C[i*ldc + j] += tmp[i*GemmBlocking::NR + j];
+    }
+  }
+}
+
+// AVX2: every row of the tile is two 8-lane registers
+__attribute__((target("avx2,fma")))
+inline void gemm_micro_kernel_avx2(
+  size_t kc, const int* Ap, const int* Bp, int* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  __m256i acc[MR][2];
+  for (size_t i = 0; i < MR; ++i) {
+    acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + p*NR));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + p*NR + 8));
+    for (size_t i = 0; i < MR; ++i) {
+      __m256i a = _mm256_set1_epi32(Ap[p*MR + i]);
+      acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_mullo_epi32(a, b0));
+      acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_mullo_epi32(a, b1));
+    }
+  }
+  if(mr == MR && nr == NR) {
+    for (size_t i = 0; i < MR; ++i) {
+      for (size_t h = 0; h < 2; ++h) {
+        auto c = reinterpret_cast<__m256i*>(C + i*ldc + h*8);
+        _mm256_storeu_si256(c, _mm256_add_epi32(_mm256_loadu_si256(c), acc[i][h]));
+      }
+    }
+    return;
+  }
+  alignas(32) int tmp[MR*NR];
+  for (size_t i = 0; i < MR; ++i) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tmp + i*NR), acc[i][0]);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tmp + i*NR + 8), acc[i][1]);
+  }
+  gemm_add_tile(tmp, C, ldc, mr, nr);
+}
+
+__attribute__((target("avx2,fma")))
+inline void gemm_micro_kernel_avx2(
+  size_t kc, const float* Ap, const float* Bp, float* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  __m256 acc[MR][2];
+  for (size_t i = 0; i < MR; ++i) {
+    acc[i][0] = acc[i][1] = _mm256_setzero_ps();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m256 b0 = _mm256_loadu_ps(Bp + p*NR);
+    __m256 b1 = _mm256_loadu_ps(Bp + p*NR + 8);
+    for (size_t i = 0; i < MR; ++i) {
+      __m256 a = _mm256_broadcast_ss(Ap + p*MR + i);
+      acc[i][0] = _mm256_fmadd_ps(a, b0, acc[i][0]);
+      acc[i][1] = _mm256_fmadd_ps(a, b1, acc[i][1]);
+    }
+  }
+  if(mr == MR && nr == NR) {
+    for (size_t i = 0; i < MR; ++i) {
+      for (size_t h = 0; h < 2; ++h) {
+        float* c = C + i*ldc + h*8;
+        _mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), acc[i][h]));
+      }
+    }
+    return;
+  }
+  alignas(32) float tmp[MR*NR];
+  for (size_t i = 0; i < MR; ++i) {
+    _mm256_store_ps(tmp + i*NR, acc[i][0]);
+    _mm256_store_ps(tmp + i*NR + 8, acc[i][1]);
+  }
+  gemm_add_tile(tmp, C, ldc, mr, nr);
+}
+
+// AVX-512: every row of the tile is one 16-lane register; edge tiles use
+// masked loads and stores instead of a spill
+__attribute__((target("avx512f")))
+inline void gemm_micro_kernel_avx512(
+  size_t kc, const int* Ap, const int* Bp, int* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  __m512i acc[MR];
+  for (size_t i = 0; i < MR; ++i) {
+    acc[i] = _mm512_setzero_si512();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m512i b = _mm512_loadu_si512(Bp + p*NR);
+    for (size_t i = 0; i < MR; ++i) {
+      acc[i] = _mm512_add_epi32(acc[i], _mm512_mullo_epi32(_mm512_set1_epi32(Ap[p*MR + i]), b));
+    }
+  }
+  __mmask16 mask = static_cast<__mmask16>((1u << nr) - 1);
+  for (size_t i = 0; i < mr; ++i) {
+    int* c = C + i*ldc;
+    _mm512_mask_storeu_epi32(c, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, c), acc[i]));
+  }
+}
+
+__attribute__((target("avx512f")))
+inline void gemm_micro_kernel_avx512(
+  size_t kc, const float* Ap, const float* Bp, float* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  __m512 acc[MR];
+  for (size_t i = 0; i < MR; ++i) {
+    acc[i] = _mm512_setzero_ps();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    __m512 b = _mm512_loadu_ps(Bp + p*NR);
+    for (size_t i = 0; i < MR; ++i) {
+      acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(Ap[p*MR + i]), b, acc[i]);
+    }
+  }
+  __mmask16 mask = static_cast<__mmask16>((1u << nr) - 1);
+  for (size_t i = 0; i < mr; ++i) {
+    float* c = C + i*ldc;
+    _mm512_mask_storeu_ps(c, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, c), acc[i]));
+  }
+}
+
+// int8 inputs packed as int16 pairs of k (see GemmPacking), summed in int32:
+// a row of B is 16 columns times 2 k, a broadcast pair of A multiplies and
+// adds both k of all columns at once
+__attribute__((target("avx2,fma")))
+inline void gemm_micro_kernel_avx2(
+  size_t kc, const int16_t* Ap, const int16_t* Bp, int32_t* C, size_t ldc, size_t mr, size_t nr
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  __m256i acc[MR][2];
+  for (size_t i = 0; i < MR; ++i) {
+    acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+  }
+  for (size_t p = 0; p < kc; p += 2) {
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + p*NR));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + p*NR + 16));
+    for (size_t i = 0; i < MR; ++i) {
+      int32_t pair;
+      std::memcpy(&pair, Ap + p*MR + 2*i, sizeof(pair));
+      __m256i a = _mm256_set1_epi32(pair);
+      acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(a, b0));
+      acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(a, b1));
+    }
+  }
+  alignas(32) int32_t tmp[MR*NR];
+  for (size_t i = 0; i < MR; ++i) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tmp + i*NR), acc[i][0]);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tmp + i*NR + 8), acc[i][1]);
+  }
+  gemm_add_tile(tmp, C, ldc, mr, nr);
+}
+
+// the int8 kernels on AVX-512, without and with VNNI, where the multiply
+// and the add are one instruction (vpdpwssd)
+#define GEMM_INT8_AVX512_KERNEL(NAME, TARGET, MADD)                              \
+__attribute__((target(TARGET)))                                                 \
+inline void NAME(                                                               \
+  size_t kc, const int16_t* Ap, const int16_t* Bp, int32_t* C, size_t ldc,      \
+  size_t mr, size_t nr                                                          \
+) {                                                                             \
+  constexpr size_t MR = GemmBlocking::MR;                                       \
+  constexpr size_t NR = GemmBlocking::NR;                                       \
+  __m512i acc[MR];                                                              \
+  for (size_t i = 0; i < MR; ++i) {                                             \
+    acc[i] = _mm512_setzero_si512();                                            \
+  }                                                                             \
+  for (size_t p = 0; p < kc; p += 2) {                                          \
+    __m512i b = _mm512_loadu_si512(Bp + p*NR);                                  \
+    for (size_t i = 0; i < MR; ++i) {                                           \
+      int32_t pair;                                                             \
+      std::memcpy(&pair, Ap + p*MR + 2*i, sizeof(pair));                        \
+      acc[i] = MADD(acc[i], _mm512_set1_epi32(pair), b);                        \
+    }                                                                           \
+  }                                                                             \
+  __mmask16 mask = static_cast<__mmask16>((1u << nr) - 1);                      \
+  for (size_t i = 0; i < mr; ++i) {                                             \
+    int32_t* c = C + i*ldc;                                                     \
+    _mm512_mask_storeu_epi32(                                                   \
+      c, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, c), acc[i])      \
+    );                                                                          \
+  }                                                                             \
+}
+
+#define GEMM_MADD_EPI16(acc, a, b) _mm512_add_epi32(acc, _mm512_madd_epi16(a, b))
+
+GEMM_INT8_AVX512_KERNEL(gemm_micro_kernel_avx512, "avx512f,avx512bw", GEMM_MADD_EPI16)
+GEMM_INT8_AVX512_KERNEL(gemm_micro_kernel_avx512_vnni, "avx512f,avx512bw,avx512vnni",
+                        _mm512_dpwssd_epi32)
+
+#undef GEMM_MADD_EPI16
+#undef GEMM_INT8_AVX512_KERNEL
+
+#endif
+
+// the micro-kernel for In inputs summed in Acc into Out on the given
+// instruction set; falls back to a narrower one if the cpu does not
+// support it, and to the scalar kernel for types without a SIMD kernel
+template <typename In, typename Acc, typename Out>
+GemmMicroKernel<gemm_packed_t<In>, Out> gemm_micro_kernel(Isa isa = detect_isa()) {
+  using P = gemm_packed_t<In>;
+  using Kernel = GemmMicroKernel<P, Out>;
+#ifdef GEMM_X86_SIMD
+  if(isa > detect_isa()) {
+    isa = detect_isa();
+  }
+  constexpr bool same = std::is_same_v<In, Acc> && std::is_same_v<Acc, Out>;
+  if constexpr (same && (std::is_same_v<In, int> || std::is_same_v<In, float>)) {
+    if(isa >= Isa::AVX512) {
+      return static_cast<Kernel>(gemm_micro_kernel_avx512);
+    }
+    if(isa == Isa::AVX2) {
+      return static_cast<Kernel>(gemm_micro_kernel_avx2);
+    }
+  }
+  if constexpr (std::is_same_v<In, int8_t> && std::is_same_v<Acc, int32_t> &&
+                std::is_same_v<Out, int32_t>) {
+    if(isa == Isa::AVX512_VNNI) {
+      return gemm_micro_kernel_avx512_vnni;
+    }
+    if(isa == Isa::AVX512) {
+      return static_cast<Kernel>(gemm_micro_kernel_avx512);
+    }
+    if(isa == Isa::AVX2) {
+      return static_cast<Kernel>(gemm_micro_kernel_avx2);
+    }
+  }
+#endif
+  return gemm_micro_kernel_scalar<P, Acc, Out, GemmPacking<In>::KG>;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <vector>
+#include <string>
 #include "threadpool.hpp"
 #include "matrix.hpp"
 #include "benchmark/benchmark.h"
@@ -48,6 +49,8 @@ static void benchmark_matmul_parallel_false_sharing(benchmark::State& s) {
   for (auto _ : s) {
     matmul_parallel_false_sharing(N,K,M,A,B,C,threadpool);
   }
+  // one task per element of C: report the submit/dequeue throughput
+  s.SetItemsProcessed(s.iterations()*N*M);
   if (s.thread_index() == 0) {
     threadpool.shutdown();
     A.assign(N*K, 2);
@@ -93,6 +96,71 @@ BENCHMARK(benchmark_matmul_parallel_false_sharing)
   ->Unit(benchmark::kMillisecond);
 
 
+// parallel matrix multiplication
+// false sharing
+// lock-free ring buffer in front of the centralized queue
+static void benchmark_matmul_parallel_false_sharing_lock_free(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_C threadpool(s.range(1), 1 << 16);
+
+  for (auto _ : s) {
+    matmul_parallel_false_sharing(N,K,M,A,B,C,threadpool);
+  }
+  // one task per element of C: report the submit/dequeue throughput
+  s.SetItemsProcessed(s.iterations()*N*M);
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+    A.assign(N*K, 2);
+    B.assign(N*K, 1);
+    C.assign(N*K, 0);
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_false_sharing_lock_free)
+  ->Args({16,1})
+  ->Args({16,2})
+  ->Args({16,4})
+  ->Args({16,8})
+  ->Args({32,1})
+  ->Args({32,2})
+  ->Args({32,4})
+  ->Args({32,8})
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
 // parallel matrix multiplication
 // no false sharing
 static void benchmark_matmul_parallel_no_false_sharing(benchmark::State& s) {
@@ -170,7 +238,7 @@ static void benchmark_matmul_parallel_block_matrix(benchmark::State& s) {
   Threadpool_C threadpool(s.range(1));
 
   for (auto _ : s) {
-    matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,s.range(1));
+    matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,16);
   }
   if (s.thread_index() == 0) {
     threadpool.shutdown();
@@ -216,6 +284,609 @@ BENCHMARK(benchmark_matmul_parallel_block_matrix)
   ->UseRealTime()
   ->Unit(benchmark::kMillisecond);
 
+// parallel matrix multiplication
+// block multiplication on rectangular, ragged shapes (N x K x M)
+// the fifth argument is the block size, 0 for the tuned one; tuning runs
+// once per shape and machine and is cached in matmul_tiles.cache
+static void benchmark_matmul_parallel_block_matrix_ragged(benchmark::State& s) {
+  size_t N = s.range(0);
+  size_t K = s.range(1);
+  size_t M = s.range(2);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(K*M, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_C threadpool(s.range(3));
+
+  // tune outside of the timing loop
+  matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,s.range(4));
+
+  for (auto _ : s) {
+    matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,s.range(4));
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_block_matrix_ragged)
+  ->Args({1000,4096,77,1,16})
+  ->Args({1000,4096,77,1,0})
+  ->Args({1000,4096,77,4,16})
+  ->Args({1000,4096,77,4,0})
+  ->Args({1000,4096,77,8,16})
+  ->Args({1000,4096,77,8,0})
+  ->Args({77,1000,513,1,16})
+  ->Args({77,1000,513,1,0})
+  ->Args({77,1000,513,4,16})
+  ->Args({77,1000,513,4,0})
+  ->Args({77,1000,513,8,16})
+  ->Args({77,1000,513,8,0})
+  ->Args({333,333,333,1,16})
+  ->Args({333,333,333,1,0})
+  ->Args({333,333,333,4,16})
+  ->Args({333,333,333,4,0})
+  ->Args({333,333,333,8,16})
+  ->Args({333,333,333,8,0})
+  ->Args({1024,1024,1024,1,16})
+  ->Args({1024,1024,1024,1,0})
+  ->Args({1024,1024,1024,4,16})
+  ->Args({1024,1024,1024,4,0})
+  ->Args({1024,1024,1024,8,16})
+  ->Args({1024,1024,1024,8,0})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// parallel matrix multiplication
+// block multiplication with split-K (N x K x M)
+// the fifth argument is the number of ranges K is split into, 1 for plain
+// owner computes; a tall K with few blocks of C needs the split to keep
+// all workers busy (the kernel caps it at about 4 tasks per worker)
+static void benchmark_matmul_parallel_block_matrix_split_k(benchmark::State& s) {
+  size_t N = s.range(0);
+  size_t K = s.range(1);
+  size_t M = s.range(2);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(K*M, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_C threadpool(s.range(3));
+
+  for (auto _ : s) {
+    matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,32,s.range(4));
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_block_matrix_split_k)
+  ->Args({64,16384,64,1,1})
+  ->Args({64,16384,64,1,4})
+  ->Args({64,16384,64,1,8})
+  ->Args({64,16384,64,4,1})
+  ->Args({64,16384,64,4,4})
+  ->Args({64,16384,64,4,8})
+  ->Args({64,16384,64,8,1})
+  ->Args({64,16384,64,8,4})
+  ->Args({64,16384,64,8,8})
+  ->Args({128,16384,128,1,1})
+  ->Args({128,16384,128,1,4})
+  ->Args({128,16384,128,1,8})
+  ->Args({128,16384,128,4,1})
+  ->Args({128,16384,128,4,4})
+  ->Args({128,16384,128,4,8})
+  ->Args({128,16384,128,8,1})
+  ->Args({128,16384,128,8,4})
+  ->Args({128,16384,128,8,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// parallel matrix multiplication
+// block multiplication with B in another layout
+// the third argument is the layout of B: 0 row-major, 1 column-major,
+// 2 tiled (64 x 64); B is converted once, outside of the timing loop, like
+// a weight matrix reused by many products
+static void benchmark_matmul_parallel_block_matrix_layout(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(K*M, 1);
+  std::vector<int>C(N*M, 0);
+  
+  PackedMatrix<int> Bp(K, M, B, static_cast<Layout>(s.range(2)), 64);
+  
+  Threadpool_C threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_parallel_block_matrix(N,K,M,A,Bp.view(),C,threadpool,32);
+  }
+  s.SetLabel(to_string(static_cast<Layout>(s.range(2))));
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_block_matrix_layout)
+  ->Args({256,1,0})
+  ->Args({256,1,1})
+  ->Args({256,1,2})
+  ->Args({256,4,0})
+  ->Args({256,4,1})
+  ->Args({256,4,2})
+  ->Args({256,8,0})
+  ->Args({256,8,1})
+  ->Args({256,8,2})
+  ->Args({512,1,0})
+  ->Args({512,1,1})
+  ->Args({512,1,2})
+  ->Args({512,4,0})
+  ->Args({512,4,1})
+  ->Args({512,4,2})
+  ->Args({512,8,0})
+  ->Args({512,8,1})
+  ->Args({512,8,2})
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// parallel matrix multiplication
+// packed GEMM engine
+// the third argument caps the SIMD of the micro-kernel: 0 scalar, 1 AVX2,
+// 2 AVX-512, 3 AVX-512 VNNI (a cpu without it runs the widest kernel it has)
+// In is the input and Out the output element type, e.g. int8 inputs
+// summed in int32
+template <typename In, typename Out>
+static void benchmark_matmul_parallel_gemm(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<In>A(N*K, 2);
+  std::vector<In>B(M*K, 1);
+  std::vector<Out>C(N*M, 0);
+  
+  Threadpool_C threadpool(s.range(1));
+  Isa isa = std::min(static_cast<Isa>(s.range(2)), detect_isa());
+  s.SetLabel(to_string(isa));
+
+  for (auto _ : s) {
+    matmul_parallel_gemm(N,K,M,A,B,C,threadpool,GemmBlocking{},isa);
+  }
+  s.counters["GOPS"] = benchmark::Counter(
+    2.0*N*M*K*s.iterations(), benchmark::Counter::kIsRate, benchmark::Counter::kIs1000
+  );
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_gemm, int, int)
+  ->Args({256,1,0})
+  ->Args({256,1,1})
+  ->Args({256,1,2})
+  ->Args({256,2,0})
+  ->Args({256,2,1})
+  ->Args({256,2,2})
+  ->Args({256,4,0})
+  ->Args({256,4,1})
+  ->Args({256,4,2})
+  ->Args({256,8,0})
+  ->Args({256,8,1})
+  ->Args({256,8,2})
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,2,0})
+  ->Args({1024,2,1})
+  ->Args({1024,2,2})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,2,0})
+  ->Args({2048,2,1})
+  ->Args({2048,2,2})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_gemm, float, float)
+  ->Args({256,1,0})
+  ->Args({256,1,1})
+  ->Args({256,1,2})
+  ->Args({256,2,0})
+  ->Args({256,2,1})
+  ->Args({256,2,2})
+  ->Args({256,4,0})
+  ->Args({256,4,1})
+  ->Args({256,4,2})
+  ->Args({256,8,0})
+  ->Args({256,8,1})
+  ->Args({256,8,2})
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,2,0})
+  ->Args({1024,2,1})
+  ->Args({1024,2,2})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,2,0})
+  ->Args({2048,2,1})
+  ->Args({2048,2,2})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_gemm, double, double)
+  ->Args({256,1,0})
+  ->Args({256,2,0})
+  ->Args({256,4,0})
+  ->Args({256,8,0})
+  ->Args({1024,1,0})
+  ->Args({1024,2,0})
+  ->Args({1024,4,0})
+  ->Args({1024,8,0})
+  ->Args({2048,1,0})
+  ->Args({2048,2,0})
+  ->Args({2048,4,0})
+  ->Args({2048,8,0})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_gemm, int8_t, int32_t)
+  ->Args({256,1,0})
+  ->Args({256,1,1})
+  ->Args({256,1,2})
+  ->Args({256,1,3})
+  ->Args({256,2,0})
+  ->Args({256,2,1})
+  ->Args({256,2,2})
+  ->Args({256,2,3})
+  ->Args({256,4,0})
+  ->Args({256,4,1})
+  ->Args({256,4,2})
+  ->Args({256,4,3})
+  ->Args({256,8,0})
+  ->Args({256,8,1})
+  ->Args({256,8,2})
+  ->Args({256,8,3})
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,1,3})
+  ->Args({1024,2,0})
+  ->Args({1024,2,1})
+  ->Args({1024,2,2})
+  ->Args({1024,2,3})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,4,3})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({1024,8,3})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,1,3})
+  ->Args({2048,2,0})
+  ->Args({2048,2,1})
+  ->Args({2048,2,2})
+  ->Args({2048,2,3})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,4,3})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->Args({2048,8,3})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// parallel matrix multiplication
+// recursive (cache-oblivious) against the block and GEMM kernels
+// the third argument is the kernel: 0 block matrix, 1 packed GEMM,
+// 2 recursive, 3 recursive with Strassen-Winograd steps from 1024 down;
+// the error of the result is checked against matmul_recursive_error_bound
+template <typename T>
+static void benchmark_matmul_parallel_recursive(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  // values in [-1, 1] so that the rounding errors show up
+  std::vector<T>A(N*K);
+  std::vector<T>B(M*K);
+  for (size_t i = 0; i < N*K; ++i) {
+    A[i] = static_cast<T>(static_cast<double>(i*7919 % 2001) / 1000 - 1);
+    B[i] = static_cast<T>(static_cast<double>(i*104729 % 2001) / 1000 - 1);
+  }
+  std::vector<T>C(N*M, 0);
+  
+  Threadpool_C threadpool(s.range(1));
+  RecursiveBlocking rb;
+  rb.strassen = s.range(2) == 3 ? 1024 : 0;
+  const char* labels[] = {"block_matrix", "gemm", "recursive", "strassen"};
+  s.SetLabel(labels[s.range(2)]);
+
+  auto multiply = [&](){
+    switch(s.range(2)) {
+      case 0: matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,32); break;
+      case 1: matmul_parallel_gemm(N,K,M,A,B,C,threadpool); break;
+      default: matmul_parallel_recursive(N,K,M,A,B,C,threadpool,rb); break;
+    }
+  };
+
+  multiply();
+  double error = matmul_relative_error(N,K,M,A,B,C);
+  s.counters["error"] = error;
+  if (!(error <= matmul_recursive_error_bound<T>(N,K,M,rb))) {
+    s.SkipWithError("result is off by more than the error bound");
+  }
+
+  for (auto _ : s) {
+    multiply();
+  }
+  s.counters["GOPS"] = benchmark::Counter(
+    2.0*N*M*K*s.iterations(), benchmark::Counter::kIsRate, benchmark::Counter::kIs1000
+  );
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_recursive, float)
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,1,3})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,4,3})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({1024,8,3})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,1,3})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,4,3})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->Args({2048,8,3})
+  ->Args({4096,1,0})
+  ->Args({4096,1,1})
+  ->Args({4096,1,2})
+  ->Args({4096,1,3})
+  ->Args({4096,4,0})
+  ->Args({4096,4,1})
+  ->Args({4096,4,2})
+  ->Args({4096,4,3})
+  ->Args({4096,8,0})
+  ->Args({4096,8,1})
+  ->Args({4096,8,2})
+  ->Args({4096,8,3})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_recursive, double)
+  ->Args({1024,1,0})
+  ->Args({1024,1,1})
+  ->Args({1024,1,2})
+  ->Args({1024,1,3})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,4,3})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({1024,8,3})
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,1,3})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,4,3})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->Args({2048,8,3})
+  ->Args({4096,1,0})
+  ->Args({4096,1,1})
+  ->Args({4096,1,2})
+  ->Args({4096,1,3})
+  ->Args({4096,4,0})
+  ->Args({4096,4,1})
+  ->Args({4096,4,2})
+  ->Args({4096,4,3})
+  ->Args({4096,8,0})
+  ->Args({4096,8,1})
+  ->Args({4096,8,2})
+  ->Args({4096,8,3})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// sparse matrix multiplication
+// A is N x N with a power-law sparsity pattern (16 nonzeros per row on
+// average, the first rows nearly dense), B is N x 64
+// the third argument is the kernel: 0 the dense GEMM on A with its zeros,
+// 1 CSR with the rows cut by row count, 2 CSR with the rows cut by nonzero
+// count, 3 BSR (4 x 4 blocks) cut by nonzero count
+static void benchmark_matmul_parallel_sparse(benchmark::State& s) {
+  size_t N = s.range(0);
+  size_t M = 64;
+  
+  auto A = power_law_csr<float>(N, N, 16, 1.0);
+  std::vector<float>B(N*M, 1);
+  std::vector<float>C(N*M, 0);
+  
+  // only the kernel that runs needs its format
+  std::vector<float>Ad;
+  BsrMatrix<float>Ab;
+  if (s.range(2) == 0) {
+    Ad = A.to_dense();
+  }
+  if (s.range(2) == 3) {
+    Ab = BsrMatrix<float>::from_csr(A, 4);
+  }
+  
+  Threadpool_C threadpool(s.range(1));
+  const char* labels[] = {"dense", "csr_rows", "csr_nonzeros", "bsr_nonzeros"};
+  s.SetLabel(labels[s.range(2)]);
+
+  for (auto _ : s) {
+    switch (s.range(2)) {
+      case 0: matmul_parallel_gemm(N,N,M,Ad,B,C,threadpool); break;
+      case 1: matmul_parallel_csr(A,M,B,C,threadpool,0,RowPartition::ROWS); break;
+      case 2: matmul_parallel_csr(A,M,B,C,threadpool); break;
+      default: matmul_parallel_bsr(Ab,M,B,C,threadpool); break;
+    }
+  }
+  s.counters["nnz"] = A.nnz();
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_sparse)
+  ->Args({2048,1,0})
+  ->Args({2048,1,1})
+  ->Args({2048,1,2})
+  ->Args({2048,1,3})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,4,3})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->Args({2048,8,3})
+  ->Args({8192,1,0})
+  ->Args({8192,1,1})
+  ->Args({8192,1,2})
+  ->Args({8192,1,3})
+  ->Args({8192,4,0})
+  ->Args({8192,4,1})
+  ->Args({8192,4,2})
+  ->Args({8192,4,3})
+  ->Args({8192,8,0})
+  ->Args({8192,8,1})
+  ->Args({8192,8,2})
+  ->Args({8192,8,3})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// sparse matrix-vector multiplication
+// A is N x N with a power-law sparsity pattern as above
+// the third argument is the kernel: 0 CSR with the rows cut by row count,
+// 1 CSR with the rows cut by nonzero count, 2 BSR (4 x 4 blocks) cut by
+// nonzero count
+static void benchmark_matvec_parallel_sparse(benchmark::State& s) {
+  size_t N = s.range(0);
+  
+  auto A = power_law_csr<float>(N, N, 16, 1.0);
+  auto Ab = BsrMatrix<float>::from_csr(A, 4);
+  std::vector<float>x(N, 1);
+  std::vector<float>y(N, 0);
+  
+  Threadpool_C threadpool(s.range(1));
+  const char* labels[] = {"csr_rows", "csr_nonzeros", "bsr_nonzeros"};
+  s.SetLabel(labels[s.range(2)]);
+
+  for (auto _ : s) {
+    switch (s.range(2)) {
+      case 0: matvec_parallel_csr(A,x,y,threadpool,0,RowPartition::ROWS); break;
+      case 1: matvec_parallel_csr(A,x,y,threadpool); break;
+      default: matvec_parallel_bsr(Ab,x,y,threadpool); break;
+    }
+  }
+  s.counters["nnz"] = A.nnz();
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matvec_parallel_sparse)
+  ->Args({16384,1,0})
+  ->Args({16384,1,1})
+  ->Args({16384,1,2})
+  ->Args({16384,4,0})
+  ->Args({16384,4,1})
+  ->Args({16384,4,2})
+  ->Args({16384,8,0})
+  ->Args({16384,8,1})
+  ->Args({16384,8,2})
+  ->Args({262144,1,0})
+  ->Args({262144,1,1})
+  ->Args({262144,1,2})
+  ->Args({262144,4,0})
+  ->Args({262144,4,1})
+  ->Args({262144,4,2})
+  ->Args({262144,8,0})
+  ->Args({262144,8,1})
+  ->Args({262144,8,2})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
 // parallel matrix multiplication
 // decentralized queue
 static void benchmark_matmul_parallel_decentralized(benchmark::State& s) {
@@ -294,7 +965,7 @@ static void benchmark_matmul_parallel_decentralized_block_matrix(benchmark::Stat
   Threadpool_D threadpool(s.range(1));
 
   for (auto _ : s) {
-    matmul_parallel_decentralized_block_matrix(N,K,M,A,B,C,threadpool,s.range(1));
+    matmul_parallel_decentralized_block_matrix(N,K,M,A,B,C,threadpool,16);
   }
   if (s.thread_index() == 0) {
     threadpool.shutdown();
@@ -341,5 +1012,667 @@ BENCHMARK(benchmark_matmul_parallel_decentralized_block_matrix)
   ->Unit(benchmark::kMillisecond);
 
 
+// parallel matrix multiplication
+// work-stealing queues
+static void benchmark_matmul_parallel_work_stealing(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_W threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_parallel_decentralized(N,K,M,A,B,C,threadpool);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+    A.assign(N*K, 2);
+    B.assign(N*K, 1);
+    C.assign(N*K, 0);
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_work_stealing)
+  ->Args({16,1})
+  ->Args({16,2})
+  ->Args({16,4})
+  ->Args({16,8})
+  ->Args({32,1})
+  ->Args({32,2})
+  ->Args({32,4})
+  ->Args({32,8})
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
 
-BENCHMARK_MAIN();
+// parallel matrix multiplication
+// work-stealing queues
+// block multiplication
+static void benchmark_matmul_parallel_work_stealing_block_matrix(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_W threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_parallel_decentralized_block_matrix(N,K,M,A,B,C,threadpool,16);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+    A.assign(N*K, 2);
+    B.assign(N*K, 1);
+    C.assign(N*K, 0);
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_work_stealing_block_matrix)
+  ->Args({16,1})
+  ->Args({16,2})
+  ->Args({16,4})
+  ->Args({16,8})
+  ->Args({32,1})
+  ->Args({32,2})
+  ->Args({32,4})
+  ->Args({32,8})
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// parallel matrix multiplication
+// decentralized queue
+// workers pinned to cpus
+// the third argument is the placement: 0 none, 1 compact, 2 scatter,
+// 3 physical cores
+static void benchmark_matmul_parallel_decentralized_pinned(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Threadpool_D threadpool(s.range(1), IdlePolicy{}, static_cast<Placement>(s.range(2)));
+
+  for (auto _ : s) {
+    matmul_parallel_decentralized(N,K,M,A,B,C,threadpool);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+    A.assign(N*K, 2);
+    B.assign(N*K, 1);
+    C.assign(N*K, 0);
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_decentralized_pinned)
+  ->Args({256,2,0})
+  ->Args({256,2,1})
+  ->Args({256,2,2})
+  ->Args({256,2,3})
+  ->Args({256,4,0})
+  ->Args({256,4,1})
+  ->Args({256,4,2})
+  ->Args({256,4,3})
+  ->Args({256,8,0})
+  ->Args({256,8,1})
+  ->Args({256,8,2})
+  ->Args({256,8,3})
+  ->Args({512,2,0})
+  ->Args({512,2,1})
+  ->Args({512,2,2})
+  ->Args({512,2,3})
+  ->Args({512,4,0})
+  ->Args({512,4,1})
+  ->Args({512,4,2})
+  ->Args({512,4,3})
+  ->Args({512,8,0})
+  ->Args({512,8,1})
+  ->Args({512,8,2})
+  ->Args({512,8,3})
+  ->Args({1024,2,0})
+  ->Args({1024,2,1})
+  ->Args({1024,2,2})
+  ->Args({1024,2,3})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,4,3})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({1024,8,3})
+  ->Args({2048,2,0})
+  ->Args({2048,2,1})
+  ->Args({2048,2,2})
+  ->Args({2048,2,3})
+  ->Args({2048,4,0})
+  ->Args({2048,4,1})
+  ->Args({2048,4,2})
+  ->Args({2048,4,3})
+  ->Args({2048,8,0})
+  ->Args({2048,8,1})
+  ->Args({2048,8,2})
+  ->Args({2048,8,3})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// tail completion time of an imbalanced task mix
+// decentralized queue
+// every 8th task multiplies 32 rows of a 64x64 matrix, the others one
+// row; two threads insert concurrently and wait without helping, so the
+// placement alone decides when the last task finishes
+// the third argument is the balance: 0 round robin, 1 two choices,
+// 2 least loaded
+static void benchmark_decentralized_imbalanced(benchmark::State& s) {
+  size_t T = s.range(0);
+  size_t n = 64;
+
+  std::vector<int>A(n*n, 2);
+  std::vector<int>B(n*n, 1);
+
+  Threadpool_D threadpool(s.range(1), IdlePolicy{}, Placement::NONE,
+                          static_cast<Balance>(s.range(2)));
+
+  auto rows = [&A, &B, n](size_t m){
+    int sum = 0;
+    for (size_t i = 0; i < m; ++i) {
+      for (size_t k = 0; k < n; ++k) {
+        for (size_t j = 0; j < n; ++j) {
+          sum += A[i*n + k] * B[k*n + j];
+        }
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  };
+
+  for (auto _ : s) {
+    TaskGroup group;
+    auto submit = [&](size_t beg, size_t end){
+      for (size_t t = beg; t < end; ++t) {
+        threadpool.insert(group, [&rows, t](){ rows(t%8 == 0 ? 32 : 1); });
+      }
+    };
+    std::thread other(submit, T/2, T);
+    submit(0, T/2);
+    other.join();
+    group.wait();
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_decentralized_imbalanced)
+  ->Args({1024,2,0})
+  ->Args({1024,2,1})
+  ->Args({1024,2,2})
+  ->Args({1024,4,0})
+  ->Args({1024,4,1})
+  ->Args({1024,4,2})
+  ->Args({1024,8,0})
+  ->Args({1024,8,1})
+  ->Args({1024,8,2})
+  ->Args({16384,2,0})
+  ->Args({16384,2,1})
+  ->Args({16384,2,2})
+  ->Args({16384,4,0})
+  ->Args({16384,4,1})
+  ->Args({16384,4,2})
+  ->Args({16384,8,0})
+  ->Args({16384,8,1})
+  ->Args({16384,8,2})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// parallel matrix multiplication chain E = (A*B)*D
+// centralized queue
+// barrier between the two products
+static void benchmark_matmul_chain_staged(benchmark::State& s) {
+  size_t N = s.range(0);
+  
+  std::vector<int>A(N*N, 2);
+  std::vector<int>B(N*N, 1);
+  std::vector<int>D(N*N, 1);
+  std::vector<int>C(N*N, 0);
+  std::vector<int>E(N*N, 0);
+  
+  Threadpool_C threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_chain_staged(N,A,B,D,C,E,threadpool);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_chain_staged)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// parallel matrix multiplication chain E = (A*B)*D
+// centralized queue
+// task graph with row-block dependencies
+static void benchmark_matmul_chain_graph(benchmark::State& s) {
+  size_t N = s.range(0);
+  
+  std::vector<int>A(N*N, 2);
+  std::vector<int>B(N*N, 1);
+  std::vector<int>D(N*N, 1);
+  std::vector<int>C(N*N, 0);
+  std::vector<int>E(N*N, 0);
+  
+  Threadpool_C threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_chain_graph(N,A,B,D,C,E,threadpool);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK(benchmark_matmul_chain_graph)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// parallel matrix multiplication
+// elastic pool: starts with one worker and grows up to the second
+// argument while the queue is deep, retiring idle workers in between
+static void benchmark_matmul_parallel_elastic(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+
+  ElasticPolicy policy;
+  policy.min_workers = 1;
+  policy.max_workers = s.range(1);
+  
+  Threadpool_E threadpool(policy);
+
+  for (auto _ : s) {
+    matmul_parallel_decentralized(N,K,M,A,B,C,threadpool);
+  }
+  s.counters["workers"] = threadpool.num_workers();
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+    A.assign(N*K, 2);
+    B.assign(N*K, 1);
+    C.assign(N*K, 0);
+  } 
+}
+
+BENCHMARK(benchmark_matmul_parallel_elastic)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({128,1})
+  ->Args({128,2})
+  ->Args({128,4})
+  ->Args({128,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({512,1})
+  ->Args({512,2})
+  ->Args({512,4})
+  ->Args({512,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// every queue layout and idle policy of BasicThreadpool
+using Pool_Centralized       = BasicThreadpool<CentralizedQueue>;
+using Pool_RoundRobin        = BasicThreadpool<RoundRobinQueues>;
+using Pool_WorkStealing      = BasicThreadpool<WorkStealingQueues>;
+using Pool_Centralized_Spin  = BasicThreadpool<CentralizedQueue, SpinIdle<4096, 64>>;
+using Pool_RoundRobin_Spin   = BasicThreadpool<RoundRobinQueues, SpinIdle<4096, 64>>;
+using Pool_WorkStealing_Spin = BasicThreadpool<WorkStealingQueues, SpinIdle<4096, 64>>;
+
+// parallel matrix multiplication
+// block multiplication on a BasicThreadpool
+template <typename Pool>
+static void benchmark_matmul_parallel_block_matrix_basic(benchmark::State& s) {
+  size_t N, M, K;
+  N = s.range(0);
+  M = s.range(0);
+  K = s.range(0);
+  
+  std::vector<int>A(N*K, 2);
+  std::vector<int>B(M*K, 1);
+  std::vector<int>C(N*M, 0);
+  
+  Pool threadpool(s.range(1));
+
+  for (auto _ : s) {
+    matmul_parallel_block_matrix(N,K,M,A,B,C,threadpool,16);
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  } 
+}
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_Centralized)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_RoundRobin)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_WorkStealing)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_Centralized_Spin)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_RoundRobin_Spin)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_matmul_parallel_block_matrix_basic, Pool_WorkStealing_Spin)
+  ->Args({64,1})
+  ->Args({64,2})
+  ->Args({64,4})
+  ->Args({64,8})
+  ->Args({256,1})
+  ->Args({256,2})
+  ->Args({256,4})
+  ->Args({256,8})
+  ->Args({1024,1})
+  ->Args({1024,2})
+  ->Args({1024,4})
+  ->Args({1024,8})
+  ->Args({2048,1})
+  ->Args({2048,2})
+  ->Args({2048,4})
+  ->Args({2048,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+
+#ifdef THREADPOOL_COROUTINES
+
+// parallel matrix multiplication
+// coroutines on the work-stealing pool
+// range(2) requests, each its own product, in flight at once
+static void benchmark_matmul_parallel_async(benchmark::State& s) {
+  size_t N = s.range(0);
+  size_t R = s.range(2);
+
+  std::vector<int>A(N*N, 2);
+  std::vector<int>B(N*N, 1);
+  std::vector<std::vector<int>>C(R, std::vector<int>(N*N, 0));
+
+  Threadpool_W threadpool(s.range(1));
+
+  for (auto _ : s) {
+    std::vector<task<void>> requests;
+    for (size_t r = 0; r < R; ++r) {
+      requests.push_back(matmul_parallel_async(N,N,N,A,B,C[r],threadpool));
+    }
+    sync_wait(when_all(std::move(requests)));
+  }
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_matmul_parallel_async)
+  ->Args({64,1,1})
+  ->Args({64,1,16})
+  ->Args({64,1,256})
+  ->Args({64,2,1})
+  ->Args({64,2,16})
+  ->Args({64,2,256})
+  ->Args({64,4,1})
+  ->Args({64,4,16})
+  ->Args({64,4,256})
+  ->Args({64,8,1})
+  ->Args({64,8,16})
+  ->Args({64,8,256})
+  ->Args({256,1,1})
+  ->Args({256,1,16})
+  ->Args({256,1,256})
+  ->Args({256,2,1})
+  ->Args({256,2,16})
+  ->Args({256,2,256})
+  ->Args({256,4,1})
+  ->Args({256,4,16})
+  ->Args({256,4,256})
+  ->Args({256,8,1})
+  ->Args({256,8,16})
+  ->Args({256,8,256})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+#endif
+
+// same as BENCHMARK_MAIN(), plus --trace=<file> to record a Chrome trace
+// of every task the pools run (open it in Perfetto)
+int main(int argc, char** argv) {
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--trace=", 0) == 0) {
+      Tracer::start(arg.substr(8));
+    }
+    else if (arg == "--trace") {
+      Tracer::start();
+    }
+    else {
+      args.push_back(argv[i]);
+    }
+  }
+  int n = static_cast<int>(args.size());
+  benchmark::Initialize(&n, args.data());
+  if (benchmark::ReportUnrecognizedArguments(n, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  Tracer::stop();
+  return 0;
+}
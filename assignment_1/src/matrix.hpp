@@ -1,202 +1,1180 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <future>
 #include <queue>
+#include <sstream>
+#include <type_traits>
+#include <typeinfo>
 #include "threadpool.hpp"
+#include "basic_threadpool.hpp"
+#include "task_group.hpp"
+#include "task_graph.hpp"
+#include "gemm_kernels.hpp"
+#include "tile_tuner.hpp"
+#include "matrix_view.hpp"
+#include "sparse_matrix.hpp"
 
 // A is N * K
 // B is K * M
 // C is N * M
+// the sequential, block and GEMM kernels also take B as a MatrixView in any
+// layout (see matrix_view.hpp)
+// the kernels take In elements, sum their products in Acc (int32 for int8,
+// otherwise In itself, see accumulator_t) and add the sums to Out elements
+
+// a*b in the accumulator type
+template <typename Acc, typename In>
+Acc mul(In a, In b) {
+  return static_cast<Acc>(a) * static_cast<Acc>(b);
+}
 
 // sequential matrix multiplication
+template <typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_sequential(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C
 ) {
 
   for (size_t i = 0; i < N; i++) {
     for (size_t j = 0; j < M; j++) {
       //C[i*M + j] = 0;
       for (size_t k = 0; k < K; k++) {
-        C[i*M + j] += A[i*K + k] * B[k*M + j];
+        C[i*M + j] += mul<Acc>(A[i*K + k], B[k*M + j]);
       }
     }
   }
 }
 
+// sum of A[i, kb:ke] * B[kb:ke, j] for the row a of A, reading the column
+// of B one contiguous run at a time (see MatrixView::column_run)
+template <typename Acc, typename In>
+Acc matmul_dot(const In* a, const MatrixView<In>& B, size_t kb, size_t ke, size_t j) {
+  Acc sum = 0;
+  for (size_t k = kb; k < ke; ) {
+    const In* b = &B(k, j);
+    size_t n = std::min(ke - k, B.column_run(k));
+    for (size_t q = 0; q < n; ++q) {
+      sum += mul<Acc>(a[k+q], b[q]);
+    }
+    k += n;
+  }
+  return sum;
+}
+
+// sequential matrix multiplication, B in any layout
+template <typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_sequential(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const MatrixView<In>& B,
+  std::vector<Out>& C
+) {
+
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      C[i*M + j] += matmul_dot<Acc>(A.data() + i*K, B, 0, K, j);
+    }
+  }
+}
+
 // parallel matrix multiplication
 // centralized queue
 // false sharing 
+// Pool can be any pool with insert_range, e.g. Threadpool_C or a BasicThreadpool
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_parallel_false_sharing(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C,
-  Threadpool_C& threadpool
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool
 ) {
 
-  std::vector<std::future<void>> futures;
-  
-  for (size_t i = 0; i < N; i++) {
-    for (size_t j = 0; j < M; j++) {
-      futures.emplace_back(
-        threadpool.insert([=, &A, &B, &C](){
-          for (size_t k = 0; k < K; k++) {
-            C[i*M + j] += A[i*K + k] * B[k*M + j];
-          }
-        })
-      );
+  TaskGroup group;
+
+  // one task per element of C, submitted as a single batch
+  threadpool.insert_range(group, N*M, [=, &A, &B, &C](size_t t){
+    size_t i = t / M;
+    size_t j = t % M;
+    for (size_t k = 0; k < K; k++) {
+      C[i*M + j] += mul<Acc>(A[i*K + k], B[k*M + j]);
     }
-  }
-  
-  for(auto& fu : futures) {
-    fu.get();
-  }
+  });
+
+  threadpool.wait(group);
 }
 
 // parallel matrix multiplication
 // no false sharing
+// Pool can be Threadpool_C or any other pool with a TaskGroup wait
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_parallel_no_false_sharing(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C,
-  Threadpool_C& threadpool
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool
 ) {
 
-  std::vector<std::future<void>> futures;
+  TaskGroup group;
   
   for (size_t i = 0; i < N; i++) {
-    futures.emplace_back(
-      threadpool.insert([=, &A, &B, &C](){
-        for (size_t j = 0; j < M; j++) {
-          for (size_t k = 0; k < K; k++) {
-            C[i*M + j] += A[i*K + k] * B[k*M + j];
-          }
+    threadpool.insert(group, labeled("row", [=, &A, &B, &C](){
+      for (size_t j = 0; j < M; j++) {
+        for (size_t k = 0; k < K; k++) {
+          C[i*M + j] += mul<Acc>(A[i*K + k], B[k*M + j]);
         }
-      })
-    );
+      }
+    }));
   }
   
-  for(auto& fu : futures) {
-    fu.get();
+  threadpool.wait(group);
+}
+
+
+// tile size of a block kernel for this shape, layout of B, accumulator
+// and number of workers of the pool, tuned on first use by running the
+// kernel as run(n, k, m, A, B, C, tile) on a proxy of the shape (at most
+// 256 along every dimension, keeping the ragged edges) with B in the
+// layout of the real one
+template <typename In, typename Out, typename Acc, typename Run>
+size_t tuned_block(
+  const char* kernel, size_t N, size_t K, size_t M, const MatrixView<In>& like,
+  size_t workers, Run&& run
+) {
+
+  std::ostringstream key;
+  key << kernel << '<' << typeid(In).name() << ',' << typeid(Out).name() << ','
+      << typeid(Acc).name() << ">/" << N << 'x' << K << 'x' << M << '/'
+      << to_string(like.layout) << "/w" << workers;
+
+  auto proxy = [](size_t d){ return d <= 256 ? d : 240 + d%16; };
+  size_t n = proxy(N), k = proxy(K), m = proxy(M);
+
+  return TileTuner::instance().tile(key.str(), [&](size_t tile){
+    std::vector<In> A(n*k, 1);
+    PackedMatrix<In> B(k, m, std::vector<In>(k*m, 1), like.layout, like.tile);
+    std::vector<Out> C(n*m, 0);
+    return TileTuner::measure([&](){ run(n, k, m, A, B.view(), C, tile); });
+  });
+}
+
+// acc += A[i:ie, kb:ke] * B[kb:ke, j:je], acc is row-major with leading
+// dimension ld. A row-major B is read a row at a time, walking K in steps
+// of block so that the rows of B of a step stay in cache for every row of
+// the tile; any other layout is read a column at a time, as one long dot
+// product per element. The inner loop is unit-stride either way
+template <typename Acc, typename In>
+void matmul_tile(
+  size_t K,
+  size_t i, size_t ie, size_t j, size_t je, size_t kb, size_t ke, size_t block,
+  const In* A, const MatrixView<In>& B, Acc* acc, size_t ld
+) {
+  if(B.layout != Layout::ROW_MAJOR) {
+    for (size_t bi = i; bi < ie; ++bi) {
+      for (size_t bj = j; bj < je; ++bj) {
+        acc[(bi-i)*ld + (bj-j)] += matmul_dot<Acc>(A + bi*K, B, kb, ke, bj);
+      }
+    }
+    return;
+  }
+  for (size_t k = kb; k < ke; k += block) {
+    size_t kend = std::min(ke, k+block);
+    for (size_t bi = i; bi < ie; ++bi) {
+      Acc* row = acc + (bi-i)*ld;
+      for (size_t bk = k; bk < kend; ++bk) {
+        Acc a = A[bi*K+bk];
+        const In* b = B.data + bk*B.cols;
+        for (size_t bj = j; bj < je; ++bj) {
+          row[bj-j] += a * static_cast<Acc>(b[bj]);
+        }
+      }
+    }
   }
 }
 
+// ----------------------------------------------------------------------------
+// Class definition for BlockProduct
+// The tasks of an owner-computes block product: task t owns block t/S of C
+// (row-major over the NB x MB blocks) and walks its share t%S of K itself,
+// so no two tasks write the same element of C. With S == 1 a task adds its
+// block straight to C. With S > 1 (split-K, for a tall K and too few blocks
+// of C to keep the workers busy) every task sums into its own scratch block
+// and the last of the S tasks of a block to finish adds the S scratch
+// blocks to C. S is capped so that there are not many more than 4 tasks
+// per worker: split-K only runs when C has few blocks, and its scratch
+// stays at a few blocks per worker instead of S copies of C.
+// ----------------------------------------------------------------------------
+
+template <typename In, typename Out, typename Acc>
+class BlockProduct {
+
+  public:
+
+    BlockProduct(
+      size_t N, size_t K, size_t M,
+      const std::vector<In>& A, const MatrixView<In>& B, std::vector<Out>& C,
+      size_t block, size_t S, size_t workers
+    ) :
+      N{N}, K{K}, M{M}, A{A}, B{B}, C{C}, block{block},
+      NB{(N+block-1)/block}, MB{(M+block-1)/block}, KB{(K+block-1)/block},
+      S{std::max<size_t>(1, std::min({S, KB, ceil_div(4*workers, std::max<size_t>(1, NB*MB))}))} {
+
+      if(this->S > 1) {
+        // left uninitialized, every task clears its own scratch block
+        scratch.reset(new Acc[size() * block*block]);
+        pending.reset(new std::atomic<size_t>[NB*MB]);
+        for (size_t b = 0; b < NB*MB; ++b) {
+          pending[b].store(this->S, std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // number of tasks
+    size_t size() const {
+      return NB*MB*S;
+    }
+
+    void operator () (size_t t) const {
+      size_t b  = t / S;
+      size_t i  = b / MB * block;
+      size_t j  = b % MB * block;
+      size_t ie = std::min(N, i+block);
+      size_t je = std::min(M, j+block);
+      size_t w  = je - j;
+      // the range of K is a whole number of blocks
+      size_t kb = std::min(K, KB * (t%S) / S * block);
+      size_t ke = std::min(K, KB * (t%S + 1) / S * block);
+
+      if(S == 1) {
+        thread_local std::vector<Acc> acc;
+        acc.assign(block*block, Acc{0});
+        matmul_tile(K, i, ie, j, je, kb, ke, block, A.data(), B, acc.data(), w);
+        add(i, ie, j, je, acc.data());
+        return;
+      }
+
+      Acc* mine = scratch.get() + t*block*block;
+      std::fill(mine, mine + (ie-i)*w, Acc{0});
+      matmul_tile(K, i, ie, j, je, kb, ke, block, A.data(), B, mine, w);
+
+      // the last one in sees the other scratch blocks of b (acq_rel)
+      if(pending[b].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Acc* first = scratch.get() + b*S*block*block;
+        for (size_t s = 1; s < S; ++s) {
+          const Acc* other = first + s*block*block;
+          for (size_t e = 0; e < (ie-i)*w; ++e) {
+            first[e] += other[e];
+          }
+        }
+        add(i, ie, j, je, first);
+      }
+    }
+
+  private:
+
+    static size_t ceil_div(size_t a, size_t b) {
+      return (a+b-1)/b;
+    }
+
+    // C[i:ie, j:je] += acc
+    void add(size_t i, size_t ie, size_t j, size_t je, const Acc* acc) const {
+      size_t w = je - j;
+      for (size_t bi = i; bi < ie; ++bi) {
+        for (size_t bj = j; bj < je; ++bj) {
+          C[bi*M+bj] += static_cast<Out>(acc[(bi-i)*w + (bj-j)]);
+        }
+      }
+    }
+
+    size_t N, K, M;
+    const std::vector<In>& A;
+    MatrixView<In> B;
+    std::vector<Out>& C;
+    size_t block, NB, MB, KB, S;
+    std::unique_ptr<Acc[]> scratch;
+    std::unique_ptr<std::atomic<size_t>[]> pending;
+};
 
 // parallel matrix multiplication
-// block multiplication
-// block size is 16
+// block multiplication, owner computes (see BlockProduct)
+// block size is T, or tuned per shape, machine and pool size if T is 0 (see TileTuner)
+// S > 1 splits K into at most S ranges as well (split-K), for a tall K
+// with few blocks of C (see BlockProduct)
+// any shape: the blocks at the edges are cut to the matrices
+// Pool can be any pool with insert_range, e.g. Threadpool_C or a BasicThreadpool
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_parallel_block_matrix(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C,
-  Threadpool_C& threadpool,
-  const size_t T
+  const std::vector<In>& A,
+  const MatrixView<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  const size_t T = 0,
+  const size_t S = 1
 ) {
 
-  std::vector<std::future<void>> futures;
-  size_t block = 16;
- 
-  for (size_t i = 0; i < N; i+=block) {
-    for (size_t j = 0; j < M; j+=block) {
-      for (size_t k = 0; k < K; k+=block) {
-        futures.emplace_back(
-          threadpool.insert([=,&A,&B,&C](){
-            for (size_t bi = i; bi < i+block; ++bi) {
-              for (size_t bj = j; bj < j+block; ++bj) {
-                size_t sum = 0;
-                for (size_t bk = k; bk < k+block; ++bk) {
-                  sum += A[bi*K+bk] * B[bk*M+bj];
-                }
-                C[bi*M+bj] += sum;
-              }
-            }
-          })
-        );
-      }
+  size_t block = T ? T : tuned_block<In, Out, Acc>("block_matrix", N, K, M, B, threadpool.num_workers(),
+    [&threadpool](size_t n, size_t k, size_t m, auto& a, auto b, auto& c, size_t t){
+      matmul_parallel_block_matrix<Pool, In, Out, Acc>(n, k, m, a, b, c, threadpool, t);
     }
-  }
+  );
+
+  BlockProduct<In, Out, Acc> product(N, K, M, A, B, C, block, S, threadpool.num_workers());
+ 
+  TaskGroup group;
+ 
+  // one task per block of C (and range of K), submitted as a single batch
+  threadpool.insert_range(group, product.size(), [&product](size_t t){
+    product(t);
+  });
   
   // synchronize the execution on the N*M inner products
-  for(auto& fu : futures) {
-    fu.get();
-  }
+  threadpool.wait(group);
+}
+
+// the same with a row-major B
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_block_matrix(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  const size_t T = 0,
+  const size_t S = 1
+) {
+  matmul_parallel_block_matrix<Pool, In, Out, Acc>(
+    N, K, M, A, MatrixView<In>{B.data(), K, M}, C, threadpool, T, S
+  );
 }
 
 
 // parallel matrix multiplication
 // decentralized queue
+// Pool can be Threadpool_D or Threadpool_W (or the elastic Threadpool_E)
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_parallel_decentralized(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C,
-  Threadpool_D& threadpool
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool
 ) {
 
-  std::vector<std::future<void>> futures;
+  TaskGroup group;
   
   for (size_t i = 0; i < N; i++) {
-    futures.emplace_back(
-      threadpool.insert([=, &A, &B, &C](){
-        for (size_t j = 0; j < M; j++) {
-          for (size_t k = 0; k < K; k++) {
-            C[i*M + j] += A[i*K + k] * B[k*M + j];
-          }
+    threadpool.insert(group, labeled("row", [=, &A, &B, &C](){
+      for (size_t j = 0; j < M; j++) {
+        for (size_t k = 0; k < K; k++) {
+          C[i*M + j] += mul<Acc>(A[i*K + k], B[k*M + j]);
         }
-      })
-    );
+      }
+    }));
   }
   
-  for(auto& fu : futures) {
-    fu.get();
-  }
+  threadpool.wait(group);
 }
 
 // parallel matrix multiplication
 // decentralized queues
-// block multiplication
-// block size is 16
+// block multiplication, owner computes (see BlockProduct)
+// block size is T, or tuned per shape, machine and pool size if T is 0 (see TileTuner)
+// S > 1 splits K into at most S ranges as well (split-K), for a tall K
+// with few blocks of C (see BlockProduct)
+// any shape: the blocks at the edges are cut to the matrices
+// Pool can be Threadpool_D or Threadpool_W
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
 void matmul_parallel_decentralized_block_matrix(
   size_t N, size_t K, size_t M,
-  const std::vector<int>& A,
-  const std::vector<int>& B,
-  std::vector<int>& C,
-  Threadpool_D& threadpool,
-  const size_t T
+  const std::vector<In>& A,
+  const MatrixView<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  const size_t T = 0,
+  const size_t S = 1
 ) {
 
-  std::vector<std::future<void>> futures;
-  size_t block = 16;
+  TaskGroup group;
+  size_t block = T ? T : tuned_block<In, Out, Acc>("decentralized_block_matrix", N, K, M, B, threadpool.num_workers(),
+    [&threadpool](size_t n, size_t k, size_t m, auto& a, auto b, auto& c, size_t t){
+      matmul_parallel_decentralized_block_matrix<Pool, In, Out, Acc>(n, k, m, a, b, c, threadpool, t);
+    }
+  );
+
+  BlockProduct<In, Out, Acc> product(N, K, M, A, B, C, block, S, threadpool.num_workers());
  
-  for (size_t i = 0; i < N; i+=block) {
-    for (size_t j = 0; j < M; j+=block) {
-      for (size_t k = 0; k < K; k+=block) {
-        futures.emplace_back(
-          threadpool.insert([=,&A,&B,&C](){
-            for (size_t bi = i; bi < i+block; ++bi) {
-              for (size_t bj = j; bj < j+block; ++bj) {
-                size_t sum = 0;
-                for (size_t bk = k; bk < k+block; ++bk) {
-                  sum += A[bi*K+bk] * B[bk*M+bj];
-                }
-                C[bi*M+bj] += sum;
+  for (size_t t = 0; t < product.size(); ++t) {
+    threadpool.insert(group, labeled("block", [&product, t](){
+      product(t);
+    }));
+  }
+  
+  // synchronize the execution on the N*M inner products
+  threadpool.wait(group);
+}
+
+// the same with a row-major B
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_decentralized_block_matrix(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  const size_t T = 0,
+  const size_t S = 1
+) {
+  matmul_parallel_decentralized_block_matrix<Pool, In, Out, Acc>(
+    N, K, M, A, MatrixView<In>{B.data(), K, M}, C, threadpool, T, S
+  );
+}
+
+// C[rows of block r] = A[rows of block r] * B
+// all matrices are N * N
+template <typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_row_block(
+  size_t N, size_t r, size_t block,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C
+) {
+  size_t end = std::min(N, r+block);
+  for (size_t i = r; i < end; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      C[i*N + j] = 0;
+    }
+    for (size_t k = 0; k < N; ++k) {
+      Acc a = A[i*N + k];
+      for (size_t j = 0; j < N; ++j) {
+        C[i*N + j] += a * static_cast<Acc>(B[k*N + j]);
+      }
+    }
+  }
+}
+
+// parallel matrix multiplication chain
+// C = A*B, then E = C*D, all matrices are N * N
+// staged: E is only started once all of C is done
+template <typename Pool, typename T>
+void matmul_chain_staged(
+  size_t N,
+  const std::vector<T>& A,
+  const std::vector<T>& B,
+  const std::vector<T>& D,
+  std::vector<T>& C,
+  std::vector<T>& E,
+  Pool& threadpool,
+  size_t block = 16
+) {
+
+  TaskGroup group;
+
+  for (size_t r = 0; r < N; r+=block) {
+    threadpool.insert(group, [=, &A, &B, &C](){
+      matmul_row_block(N, r, block, A, B, C);
+    });
+  }
+  threadpool.wait(group);
+
+  for (size_t r = 0; r < N; r+=block) {
+    threadpool.insert(group, [=, &C, &D, &E](){
+      matmul_row_block(N, r, block, C, D, E);
+    });
+  }
+  threadpool.wait(group);
+}
+
+// parallel matrix multiplication chain
+// C = A*B, then E = C*D, all matrices are N * N
+// task graph: a block of rows of E only needs the same block of rows
+// of C, so it starts as soon as that block is done
+template <typename Pool, typename T>
+void matmul_chain_graph(
+  size_t N,
+  const std::vector<T>& A,
+  const std::vector<T>& B,
+  const std::vector<T>& D,
+  std::vector<T>& C,
+  std::vector<T>& E,
+  Pool& threadpool,
+  size_t block = 16
+) {
+
+  TaskGraph graph;
+
+  for (size_t r = 0; r < N; r+=block) {
+    auto& c = graph.emplace([=, &A, &B, &C](){
+      matmul_row_block(N, r, block, A, B, C);
+    });
+    auto& e = graph.emplace([=, &C, &D, &E](){
+      matmul_row_block(N, r, block, C, D, E);
+    });
+    c.precede(e);
+  }
+
+  graph.run_and_wait(threadpool);
+}
+
+// ----------------------------------------------------------------------------
+// Packed GEMM engine (Goto/BLIS style)
+// C += A*B is computed in macro-tiles of mc rows and nc columns of C. For
+// every kc-deep slice of the product, the tile's rows of A are packed into
+// MR-row slivers and the slice of B into NR-column slivers, both contiguous
+// in the order the micro-kernel reads them, so the kernel streams through
+// memory with unit stride. The blocking keeps a packed sliver of B in L1,
+// the packed A block in L2 and the packed B panel in L3. The micro-kernels
+// are in gemm_kernels.hpp.
+// ----------------------------------------------------------------------------
+
+// pack rows [i, i+mc) and columns [p, p+kc) of A (lda columns) into MR-row
+// slivers, p-major within a sliver, with groups of KG consecutive p of a
+// row next to each other (see GemmPacking); rows and p past the end are
+// zero
+template <typename In, typename P = gemm_packed_t<In>>
+void gemm_pack_a(
+  size_t mc, size_t kc, const In* A, size_t lda, P* Ap
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t KG = GemmPacking<In>::KG;
+  for (size_t ir = 0; ir < mc; ir += MR) {
+    size_t mr = std::min(MR, mc - ir);
+    for (size_t p = 0; p < kc; p += KG) {
+      for (size_t i = 0; i < MR; ++i) {
+        for (size_t q = p; q < p+KG; ++q) {
+          *Ap++ = i < mr && q < kc ? static_cast<P>(A[(ir+i)*lda + q]) : P{0};
+        }
+      }
+    }
+  }
+}
+
+// pack rows [p, p+kc) and columns [j, j+nc) of B into NR-column slivers,
+// p-major within a sliver, with groups of KG consecutive p of a column next
+// to each other; columns and p past the end are zero. A row-major B is
+// read a row at a time, any other layout a column at a time
+template <typename In, typename P = gemm_packed_t<In>>
+void gemm_pack_b(
+  size_t kc, size_t nc, const MatrixView<In>& B, size_t p0, size_t j0, P* Bp
+) {
+  constexpr size_t NR = GemmBlocking::NR;
+  constexpr size_t KG = GemmPacking<In>::KG;
+  size_t depth = (kc+KG-1)/KG*KG;
+  for (size_t jr = 0; jr < nc; jr += NR, Bp += NR*depth) {
+    size_t nr = std::min(NR, nc - jr);
+    if(B.layout != Layout::ROW_MAJOR) {
+      std::fill(Bp, Bp + NR*depth, P{0});
+      for (size_t j = 0; j < nr; ++j) {
+        for (size_t p = 0; p < kc; ) {
+          const In* b = &B(p0+p, j0+jr+j);
+          size_t n = std::min(kc - p, B.column_run(p0+p));
+          for (size_t q = p; q < p+n; ++q) {
+            Bp[q/KG*NR*KG + j*KG + q%KG] = static_cast<P>(b[q-p]);
+          }
+          p += n;
+        }
+      }
+      continue;
+    }
+    const In* row = B.data + p0*B.cols + j0 + jr;
+    size_t ldb = B.cols;
+    P* out = Bp;
+    for (size_t p = 0; p < kc; p += KG) {
+      if(KG == 1) {
+        const In* b = row + p*ldb;
+        for (size_t j = 0; j < nr; ++j) {
+          *out++ = b[j];
+        }
+        for (size_t j = nr; j < NR; ++j) {
+          *out++ = 0;
+        }
+        continue;
+      }
+      for (size_t j = 0; j < NR; ++j) {
+        for (size_t q = p; q < p+KG; ++q) {
+          *out++ = j < nr && q < kc ? static_cast<P>(row[q*ldb + j]) : P{0};
+        }
+      }
+    }
+  }
+}
+
+// C[i:i+mc, j:j+nc] += A[i:i+mc, :] * B[:, j:j+nc], run by one task; the
+// packing buffers belong to the running thread and are reused across tasks
+template <typename In, typename Out, typename P = gemm_packed_t<In>>
+void gemm_macro_tile(
+  size_t K, size_t M, size_t i, size_t j, size_t mc, size_t nc,
+  const In* A, const MatrixView<In>& B, Out* C, const GemmBlocking& blk, GemmMicroKernel<P, Out> kernel
+) {
+  constexpr size_t MR = GemmBlocking::MR;
+  constexpr size_t NR = GemmBlocking::NR;
+  constexpr size_t KG = GemmPacking<In>::KG;
+
+  // the depth of a slice is rounded up to whole groups of KG
+  size_t depth = (blk.kc+KG-1)/KG*KG;
+
+  thread_local std::vector<P> Ap, Bp;
+  Ap.resize((blk.mc+MR-1)/MR*MR * depth);
+  Bp.resize((blk.nc+NR-1)/NR*NR * depth);
+
+  for (size_t p = 0; p < K; p += blk.kc) {
+    size_t kc = std::min(blk.kc, K-p);
+    gemm_pack_b(kc, nc, B, p, j, Bp.data());
+    gemm_pack_a(mc, kc, A + i*K + p, K, Ap.data());
+    kc = (kc+KG-1)/KG*KG;
+    for (size_t jr = 0; jr < nc; jr += NR) {
+      for (size_t ir = 0; ir < mc; ir += MR) {
+        kernel(
+          kc, Ap.data() + ir*kc, Bp.data() + jr*kc,
+          C + (i+ir)*M + j + jr, M, std::min(MR, mc-ir), std::min(NR, nc-jr)
+        );
+      }
+    }
+  }
+}
+
+// parallel matrix multiplication
+// packed GEMM engine, one task per macro-tile of C
+// every task owns its tile of C, so tasks never write the same element
+// the micro-kernel uses the widest SIMD of the cpu (or at most isa); int8
+// inputs are summed in int32 with pairwise dot products
+// Pool can be any pool with insert_range, e.g. Threadpool_C or a BasicThreadpool
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_gemm(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const MatrixView<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  GemmBlocking blk = {},
+  Isa isa = detect_isa()
+) {
+
+  // number of macro-tiles along each dimension of C
+  size_t NB = (N+blk.mc-1)/blk.mc;
+  size_t MB = (M+blk.nc-1)/blk.nc;
+
+  auto kernel = gemm_micro_kernel<In, Acc, Out>(isa);
+
+  TaskGroup group;
+
+  threadpool.insert_range(group, NB*MB, [=, &A, &C](size_t t){
+    size_t i = t / MB * blk.mc;
+    size_t j = t % MB * blk.nc;
+    gemm_macro_tile(
+      K, M, i, j, std::min(blk.mc, N-i), std::min(blk.nc, M-j),
+      A.data(), B, C.data(), blk, kernel
+    );
+  });
+
+  threadpool.wait(group);
+}
+
+// the same with a row-major B
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_gemm(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  GemmBlocking blk = {},
+  Isa isa = detect_isa()
+) {
+  matmul_parallel_gemm<Pool, In, Out, Acc>(
+    N, K, M, A, MatrixView<In>{B.data(), K, M}, C, threadpool, blk, isa
+  );
+}
+
+// ----------------------------------------------------------------------------
+// Recursive (cache-oblivious) matrix multiplication
+// C += A*B is split in half along its largest dimension until every side
+// is at most cutoff, and the leaves are multiplied by matmul_tile. Halving
+// the largest side keeps the blocks near-square at every level, so some
+// level fits every cache without knowing its size. The calling thread
+// splits C into blocks of about grain x grain, and each block runs the
+// recursion over all of K as one task. The recursion inside a block is
+// sequential and tasks never wait, so only the calling thread waits and a
+// worker's stack never holds more than one block.
+// Blocks with all sides at least strassen (and even) take a
+// Strassen-Winograd step instead: 7 half-size products and 15 additions in
+// place of 8 products.
+// ----------------------------------------------------------------------------
+
+struct RecursiveBlocking {
+  size_t cutoff = 64;       // largest side of a leaf
+  size_t grain = 256;       // side of the blocks of C run as one task
+  size_t strassen = 0;      // smallest side of a Strassen-Winograd step, 0 for none
+};
+
+// X[i, j] = Y[i, j] + s * Z[i, j] for n x m blocks with leading dimensions
+template <typename T>
+void matmul_axpy(
+  size_t n, size_t m, T* X, size_t ldx, const T* Y, size_t ldy, T s, const T* Z, size_t ldz
+) {
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < m; ++j) {
+      X[i*ldx + j] = Y[i*ldy + j] + s * Z[i*ldz + j];
+    }
+  }
+}
+
+// a Strassen-Winograd step should be taken on an n x k x m block
+template <typename In, typename Acc>
+bool matmul_strassen_step(const RecursiveBlocking& rb, size_t n, size_t k, size_t m) {
+  // the sums of blocks of A and B are kept in In, so In must be its own
+  // accumulator type
+  return std::is_same_v<In, Acc> && rb.strassen && std::min({n, k, m}) >= rb.strassen
+      && n%2 == 0 && k%2 == 0 && m%2 == 0;
+}
+
+// one Strassen-Winograd step on an n x k x m block (all even): the 7
+// half-size products P = a * b are started by product(n, k, m, a, lda, b,
+// ldb, P, ldp) and have all finished once sync() returns
+template <typename In, typename Out, typename Acc, typename Product, typename Sync>
+void matmul_strassen_winograd(
+  size_t n, size_t k, size_t m,
+  const In* A, size_t lda, const In* B, size_t ldb, Out* C, size_t ldc,
+  Product&& product, Sync&& sync
+) {
+  size_t n2 = n/2, k2 = k/2, m2 = m/2;
+  const In *A11 = A, *A12 = A + k2, *A21 = A + n2*lda, *A22 = A21 + k2;
+  const In *B11 = B, *B12 = B + m2, *B21 = B + k2*ldb, *B22 = B21 + m2;
+  const In one = 1, minus = static_cast<In>(-1);
+
+  std::vector<In> S(4 * n2*k2), T(4 * k2*m2);
+  In *S1 = S.data(), *S2 = S1 + n2*k2, *S3 = S2 + n2*k2, *S4 = S3 + n2*k2;
+  In *T1 = T.data(), *T2 = T1 + k2*m2, *T3 = T2 + k2*m2, *T4 = T3 + k2*m2;
+  matmul_axpy(n2, k2, S1, k2, A21, lda, one, A22, lda);     // S1 = A21 + A22
+  matmul_axpy(n2, k2, S2, k2, S1, k2, minus, A11, lda);     // S2 = S1 - A11
+  matmul_axpy(n2, k2, S3, k2, A11, lda, minus, A21, lda);   // S3 = A11 - A21
+  matmul_axpy(n2, k2, S4, k2, A12, lda, minus, S2, k2);     // S4 = A12 - S2
+  matmul_axpy(k2, m2, T1, m2, B12, ldb, minus, B11, ldb);   // T1 = B12 - B11
+  matmul_axpy(k2, m2, T2, m2, B22, ldb, minus, T1, m2);     // T2 = B22 - T1
+  matmul_axpy(k2, m2, T3, m2, B22, ldb, minus, B12, ldb);   // T3 = B22 - B12
+  matmul_axpy(k2, m2, T4, m2, T2, m2, minus, B21, ldb);     // T4 = T2 - B21
+
+  std::vector<Acc> P(7 * n2*m2, Acc{0});
+  Acc *P1 = P.data(), *P2 = P1 + n2*m2, *P3 = P2 + n2*m2, *P4 = P3 + n2*m2;
+  Acc *P5 = P4 + n2*m2, *P6 = P5 + n2*m2, *P7 = P6 + n2*m2;
+  product(n2, k2, m2, A11, lda, B11, ldb, P1, m2);
+  product(n2, k2, m2, A12, lda, B21, ldb, P2, m2);
+  product(n2, k2, m2, S4, k2, B22, ldb, P3, m2);
+  product(n2, k2, m2, A22, lda, T4, m2, P4, m2);
+  product(n2, k2, m2, S1, k2, T1, m2, P5, m2);
+  product(n2, k2, m2, S2, k2, T2, m2, P6, m2);
+  product(n2, k2, m2, S3, k2, T3, m2, P7, m2);
+  sync();
+
+  Out *C11 = C, *C12 = C + m2, *C21 = C + n2*ldc, *C22 = C21 + m2;
+  for (size_t i = 0; i < n2; ++i) {
+    for (size_t j = 0; j < m2; ++j) {
+      size_t e = i*m2 + j;
+      Acc U2 = P1[e] + P6[e];
+      Acc U3 = U2 + P7[e];
+      C11[i*ldc + j] += static_cast<Out>(P1[e] + P2[e]);
+      C12[i*ldc + j] += static_cast<Out>(U2 + P5[e] + P3[e]);
+      C21[i*ldc + j] += static_cast<Out>(U3 - P4[e]);
+      C22[i*ldc + j] += static_cast<Out>(U3 + P5[e]);
+    }
+  }
+}
+
+// C[0:n, 0:m] += A[0:n, 0:k] * B[0:k, 0:m] on row-major blocks with
+// leading dimensions lda, ldb and ldc, on the calling thread
+template <typename In, typename Out, typename Acc>
+void matmul_recursive_block(
+  const RecursiveBlocking& rb, size_t n, size_t k, size_t m,
+  const In* A, size_t lda, const In* B, size_t ldb, Out* C, size_t ldc
+) {
+  size_t big = std::max({n, k, m});
+  if(big <= rb.cutoff || n == 0 || m == 0) {
+    thread_local std::vector<Acc> acc;
+    acc.assign(n*m, Acc{0});
+    matmul_tile(lda, 0, n, 0, m, 0, k, rb.cutoff, A, MatrixView<In>{B, k, ldb}, acc.data(), m);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < m; ++j) {
+        C[i*ldc + j] += static_cast<Out>(acc[i*m + j]);
+      }
+    }
+    return;
+  }
+
+  if(matmul_strassen_step<In, Acc>(rb, n, k, m)) {
+    matmul_strassen_winograd<In, Out, Acc>(n, k, m, A, lda, B, ldb, C, ldc,
+      [&rb](size_t n, size_t k, size_t m, const In* A, size_t lda, const In* B, size_t ldb, Acc* P, size_t ldp){
+        matmul_recursive_block<In, Acc, Acc>(rb, n, k, m, A, lda, B, ldb, P, ldp);
+      },
+      [](){}
+    );
+  }
+  else if(n == big) {
+    size_t n2 = n/2;
+    matmul_recursive_block<In, Out, Acc>(rb, n2, k, m, A, lda, B, ldb, C, ldc);
+    matmul_recursive_block<In, Out, Acc>(rb, n-n2, k, m, A + n2*lda, lda, B, ldb, C + n2*ldc, ldc);
+  }
+  else if(m == big) {
+    size_t m2 = m/2;
+    matmul_recursive_block<In, Out, Acc>(rb, n, k, m2, A, lda, B, ldb, C, ldc);
+    matmul_recursive_block<In, Out, Acc>(rb, n, k, m-m2, A, lda, B + m2, ldb, C + m2, ldc);
+  }
+  else {
+    size_t k2 = k/2;
+    matmul_recursive_block<In, Out, Acc>(rb, n, k2, m, A, lda, B, ldb, C, ldc);
+    matmul_recursive_block<In, Out, Acc>(rb, n, k-k2, m, A + k2, lda, B + k2*ldb, ldb, C, ldc);
+  }
+}
+
+// the same split into tasks of group by the calling thread: C is halved
+// along its longer side down to blocks of about grain x grain, each of
+// them one task. The Strassen-Winograd steps above the grain run on the
+// calling thread, with their 7 products in parallel
+template <typename Pool, typename In, typename Out, typename Acc>
+void matmul_recursive_tasks(
+  Pool& threadpool, TaskGroup& group, const RecursiveBlocking& rb, size_t n, size_t k, size_t m,
+  const In* A, size_t lda, const In* B, size_t ldb, Out* C, size_t ldc
+) {
+  if(n == 0 || m == 0) {
+    return;
+  }
+
+  if(std::max(n, m) > rb.grain && matmul_strassen_step<In, Acc>(rb, n, k, m)) {
+    TaskGroup products;
+    matmul_strassen_winograd<In, Out, Acc>(n, k, m, A, lda, B, ldb, C, ldc,
+      [&](size_t n, size_t k, size_t m, const In* A, size_t lda, const In* B, size_t ldb, Acc* P, size_t ldp){
+        matmul_recursive_tasks<Pool, In, Acc, Acc>(threadpool, products, rb, n, k, m, A, lda, B, ldb, P, ldp);
+      },
+      [&](){ threadpool.wait(products); }
+    );
+  }
+  else if(std::max(n, m) <= rb.grain) {
+    threadpool.insert(group, [=, &rb](){
+      matmul_recursive_block<In, Out, Acc>(rb, n, k, m, A, lda, B, ldb, C, ldc);
+    });
+  }
+  else if(n >= m) {
+    size_t n2 = n/2;
+    matmul_recursive_tasks<Pool, In, Out, Acc>(threadpool, group, rb, n2, k, m, A, lda, B, ldb, C, ldc);
+    matmul_recursive_tasks<Pool, In, Out, Acc>(threadpool, group, rb, n-n2, k, m, A + n2*lda, lda, B, ldb, C + n2*ldc, ldc);
+  }
+  else {
+    size_t m2 = m/2;
+    matmul_recursive_tasks<Pool, In, Out, Acc>(threadpool, group, rb, n, k, m2, A, lda, B, ldb, C, ldc);
+    matmul_recursive_tasks<Pool, In, Out, Acc>(threadpool, group, rb, n, k, m-m2, A, lda, B + m2, ldb, C + m2, ldc);
+  }
+}
+
+// parallel matrix multiplication
+// recursive and cache-oblivious, with optional Strassen-Winograd steps
+// (for In that is its own accumulator type: int, float, double); with
+// floating-point types a Strassen-Winograd step loses some accuracy, see
+// matmul_relative_error and matmul_recursive_error_bound
+// Pool can be any pool with insert and wait
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_recursive(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  RecursiveBlocking rb = {}
+) {
+  rb.cutoff = std::max<size_t>(rb.cutoff, 1);
+  rb.grain = std::max(rb.grain, rb.cutoff);
+  rb.strassen = rb.strassen ? std::max(rb.strassen, 2*rb.cutoff) : 0;
+
+  TaskGroup group;
+  matmul_recursive_tasks<Pool, In, Out, Acc>(
+    threadpool, group, rb, N, K, M, A.data(), K, B.data(), M, C.data(), M
+  );
+  threadpool.wait(group);
+}
+
+// largest error of C = A*B over (about) samples entries spread over C,
+// relative to K * max|A| * max|B|; the reference is summed in long double.
+// C must hold exactly A*B (start from a zero C)
+template <typename In, typename Out>
+double matmul_relative_error(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  const std::vector<Out>& C,
+  size_t samples = 1024
+) {
+  long double amax = 0, bmax = 0;
+  for (auto a : A) {
+    amax = std::max(amax, std::abs(static_cast<long double>(a)));
+  }
+  for (auto b : B) {
+    bmax = std::max(bmax, std::abs(static_cast<long double>(b)));
+  }
+  long double scale = static_cast<long double>(K) * amax * bmax;
+
+  double error = 0;
+  size_t step = std::max<size_t>(1, N*M / std::max<size_t>(samples, 1));
+  for (size_t e = 0; e < N*M; e += step) {
+    size_t i = e / M, j = e % M;
+    long double ref = 0;
+    for (size_t k = 0; k < K; ++k) {
+      ref += static_cast<long double>(A[i*K + k]) * static_cast<long double>(B[k*M + j]);
+    }
+    long double diff = std::abs(static_cast<long double>(C[e]) - ref);
+    // NaN and inf count as the largest error
+    double rel = scale > 0 ? static_cast<double>(diff / scale) : static_cast<double>(diff);
+    error = std::isfinite(rel) ? std::max(error, rel) : std::numeric_limits<double>::infinity();
+  }
+  return error;
+}
+
+// bound on matmul_relative_error of matmul_parallel_recursive for a
+// floating-point T: the classical product errs by up to K*eps, and every
+// Strassen-Winograd level can grow the error by up to 12x (Higham)
+template <typename T>
+double matmul_recursive_error_bound(size_t N, size_t K, size_t M, RecursiveBlocking rb = {}) {
+  rb.strassen = rb.strassen ? std::max(rb.strassen, 2*std::max<size_t>(rb.cutoff, 1)) : 0;
+  double bound = static_cast<double>(K) * std::numeric_limits<T>::epsilon();
+  for (size_t d = std::min({N, K, M}); rb.strassen && d >= rb.strassen; d /= 2) {
+    bound *= 12;
+  }
+  return bound;
+}
+
+// ----------------------------------------------------------------------------
+// Sparse matrix multiplication
+// A is sparse (CSR or BSR, see sparse_matrix.hpp), B, C, x and y are dense
+// and row-major, and the zeros of A are never touched. The rows of A are
+// cut into ranges of about the same number of nonzeros, one task each, so
+// that a few dense rows of a skewed matrix do not hold up the rest; a task
+// owns its rows of C (or y).
+// ----------------------------------------------------------------------------
+
+// number of row ranges of a sparse kernel: parts, or 4 per worker of the
+// pool if the caller gives none
+inline size_t sparse_parts(size_t parts, size_t workers) {
+  return parts ? parts : 4 * std::max<size_t>(1, workers);
+}
+
+// parallel sparse matrix multiplication
+// C (A.rows x M) += A (CSR) * B (A.cols x M)
+// a row of C is summed in Acc over the rows of B picked by the nonzeros
+// of the row of A, so B is read with unit stride
+// Pool can be any pool with insert and wait
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_csr(
+  const CsrMatrix<In>& A, size_t M,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  size_t parts = 0,
+  RowPartition how = RowPartition::NONZEROS
+) {
+
+  auto bounds = partition_rows(A.row_ptr, sparse_parts(parts, threadpool.num_workers()), how);
+
+  TaskGroup group;
+
+  for (size_t p = 0; p+1 < bounds.size(); ++p) {
+    threadpool.insert(group, [&A, &B, &C, M, rb=bounds[p], re=bounds[p+1]](){
+      thread_local std::vector<Acc> acc;
+      acc.assign(M, Acc{0});
+      for (size_t i = rb; i < re; ++i) {
+        for (size_t e = A.row_ptr[i]; e < A.row_ptr[i+1]; ++e) {
+          Acc a = A.values[e];
+          const In* b = B.data() + A.col_idx[e]*M;
+          for (size_t j = 0; j < M; ++j) {
+            acc[j] += a * static_cast<Acc>(b[j]);
+          }
+        }
+        for (size_t j = 0; j < M; ++j) {
+          C[i*M + j] += static_cast<Out>(acc[j]);
+          acc[j] = 0;
+        }
+      }
+    });
+  }
+
+  threadpool.wait(group);
+}
+
+// parallel sparse matrix-vector multiplication
+// y (A.rows) += A (CSR) * x (A.cols)
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matvec_parallel_csr(
+  const CsrMatrix<In>& A,
+  const std::vector<In>& x,
+  std::vector<Out>& y,
+  Pool& threadpool,
+  size_t parts = 0,
+  RowPartition how = RowPartition::NONZEROS
+) {
+
+  auto bounds = partition_rows(A.row_ptr, sparse_parts(parts, threadpool.num_workers()), how);
+
+  TaskGroup group;
+
+  for (size_t p = 0; p+1 < bounds.size(); ++p) {
+    threadpool.insert(group, [&A, &x, &y, rb=bounds[p], re=bounds[p+1]](){
+      for (size_t i = rb; i < re; ++i) {
+        Acc sum = 0;
+        for (size_t e = A.row_ptr[i]; e < A.row_ptr[i+1]; ++e) {
+          sum += mul<Acc>(A.values[e], x[A.col_idx[e]]);
+        }
+        y[i] += static_cast<Out>(sum);
+      }
+    });
+  }
+
+  threadpool.wait(group);
+}
+
+// parallel sparse matrix multiplication
+// C (A.rows x M) += A (BSR) * B (A.cols x M)
+// the block rows are partitioned by their number of blocks; within a
+// block every value is used, zero or not
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matmul_parallel_bsr(
+  const BsrMatrix<In>& A, size_t M,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  size_t parts = 0,
+  RowPartition how = RowPartition::NONZEROS
+) {
+
+  auto bounds = partition_rows(A.row_ptr, sparse_parts(parts, threadpool.num_workers()), how);
+  size_t b = A.block;
+
+  TaskGroup group;
+
+  for (size_t p = 0; p+1 < bounds.size(); ++p) {
+    threadpool.insert(group, [&A, &B, &C, M, b, rb=bounds[p], re=bounds[p+1]](){
+      thread_local std::vector<Acc> acc;
+      for (size_t I = rb; I < re; ++I) {
+        // the rows of the block row, cut to the matrix
+        size_t r0 = I*b;
+        size_t nr = std::min(b, A.rows - r0);
+        acc.assign(nr*M, Acc{0});
+        for (size_t s = A.row_ptr[I]; s < A.row_ptr[I+1]; ++s) {
+          size_t c0 = A.col_idx[s]*b;
+          size_t nc = std::min(b, A.cols - c0);
+          const In* blk = A.values.data() + s*b*b;
+          for (size_t r = 0; r < nr; ++r) {
+            Acc* row = acc.data() + r*M;
+            for (size_t c = 0; c < nc; ++c) {
+              Acc a = blk[r*b + c];
+              const In* brow = B.data() + (c0+c)*M;
+              for (size_t j = 0; j < M; ++j) {
+                row[j] += a * static_cast<Acc>(brow[j]);
               }
             }
-          })
-        );
+          }
+        }
+        for (size_t e = 0; e < nr*M; ++e) {
+          C[r0*M + e] += static_cast<Out>(acc[e]);
+        }
+      }
+    });
+  }
+
+  threadpool.wait(group);
+}
+
+// parallel sparse matrix-vector multiplication
+// y (A.rows) += A (BSR) * x (A.cols)
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+void matvec_parallel_bsr(
+  const BsrMatrix<In>& A,
+  const std::vector<In>& x,
+  std::vector<Out>& y,
+  Pool& threadpool,
+  size_t parts = 0,
+  RowPartition how = RowPartition::NONZEROS
+) {
+
+  auto bounds = partition_rows(A.row_ptr, sparse_parts(parts, threadpool.num_workers()), how);
+  size_t b = A.block;
+
+  TaskGroup group;
+
+  for (size_t p = 0; p+1 < bounds.size(); ++p) {
+    threadpool.insert(group, [&A, &x, &y, b, rb=bounds[p], re=bounds[p+1]](){
+      thread_local std::vector<Acc> sum;
+      for (size_t I = rb; I < re; ++I) {
+        size_t r0 = I*b;
+        size_t nr = std::min(b, A.rows - r0);
+        sum.assign(nr, Acc{0});
+        for (size_t s = A.row_ptr[I]; s < A.row_ptr[I+1]; ++s) {
+          size_t c0 = A.col_idx[s]*b;
+          size_t nc = std::min(b, A.cols - c0);
+          const In* blk = A.values.data() + s*b*b;
+          for (size_t r = 0; r < nr; ++r) {
+            for (size_t c = 0; c < nc; ++c) {
+              sum[r] += mul<Acc>(blk[r*b + c], x[c0+c]);
+            }
+          }
+        }
+        for (size_t r = 0; r < nr; ++r) {
+          y[r0+r] += static_cast<Out>(sum[r]);
+        }
+      }
+    });
+  }
+
+  threadpool.wait(group);
+}
+
+#ifdef THREADPOOL_COROUTINES
+
+// one block of rows of C = A*B, computed on a worker of the pool
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+task<void> matmul_rows_async(
+  size_t N, size_t K, size_t M, size_t r, size_t block,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool
+) {
+  co_await threadpool.schedule();
+  size_t end = std::min(N, r+block);
+  for (size_t i = r; i < end; ++i) {
+    for (size_t k = 0; k < K; ++k) {
+      Acc a = A[i*K + k];
+      for (size_t j = 0; j < M; ++j) {
+        C[i*M + j] += a * static_cast<Acc>(B[k*M + j]);
       }
     }
   }
-  
-  // synchronize the execution on the N*M inner products
-  for(auto& fu : futures) {
-    fu.get();
+}
+
+// parallel matrix multiplication
+// coroutine: one task per block of rows, the awaiting coroutine is
+// resumed by the block that finishes last, so no thread blocks on it
+// Pool can be any pool with schedule()
+template <typename Pool, typename In, typename Out, typename Acc = accumulator_t<In>>
+task<void> matmul_parallel_async(
+  size_t N, size_t K, size_t M,
+  const std::vector<In>& A,
+  const std::vector<In>& B,
+  std::vector<Out>& C,
+  Pool& threadpool,
+  size_t block = 16
+) {
+
+  std::vector<task<void>> blocks;
+  for (size_t r = 0; r < N; r+=block) {
+    blocks.push_back(matmul_rows_async<Pool, In, Out, Acc>(N, K, M, r, block, A, B, C, threadpool));
   }
+  co_await when_all(std::move(blocks));
 }
+
+#endif
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Matrix layouts
+// The kernels read B down its columns. In a row-major B that walk has a
+// stride of M elements, so the other layouts keep the columns contiguous:
+//   ROW_MAJOR  (r, c) at r*cols + c
+//   COL_MAJOR  (r, c) at c*rows + r, i.e. the transpose of ROW_MAJOR
+//   TILED      tile x tile blocks one after the other, row-major over the
+//              blocks and column-major inside a block; the blocks at the
+//              edges are padded with zeros to a full tile
+// A matrix is converted once into a PackedMatrix and then passed to the
+// kernels as a MatrixView, e.g. for a fixed weight matrix W (K x M)
+//   PackedMatrix<float> Wt(K, M, W, Layout::COL_MAJOR);
+//   matmul_parallel_block_matrix(N, K, M, X, Wt.view(), Y, pool);
+// ----------------------------------------------------------------------------
+
+enum class Layout {
+  ROW_MAJOR,
+  COL_MAJOR,
+  TILED
+};
+
+inline const char* to_string(Layout layout) {
+  switch(layout) {
+    case Layout::COL_MAJOR: return "col_major";
+    case Layout::TILED:     return "tiled";
+    default:                return "row_major";
+  }
+}
+
+// a read-only view of a rows x cols matrix in any layout
+template <typename T>
+struct MatrixView {
+
+  const T* data;
+  size_t rows;
+  size_t cols;
+  Layout layout {Layout::ROW_MAJOR};
+  size_t tile {0};                     // TILED only, must be > 0
+
+  size_t index(size_t r, size_t c) const {
+    switch(layout) {
+      case Layout::COL_MAJOR:
+        return c*rows + r;
+      case Layout::TILED:
+        return ((r/tile) * ((cols+tile-1)/tile) + c/tile) * tile*tile + (c%tile)*tile + r%tile;
+      default:
+        return r*cols + c;
+    }
+  }
+
+  const T& operator () (size_t r, size_t c) const {
+    return data[index(r, c)];
+  }
+
+  // number of elements of a column, from row r on, that are next to each
+  // other in memory (1 for ROW_MAJOR)
+  size_t column_run(size_t r) const {
+    switch(layout) {
+      case Layout::COL_MAJOR:
+        return rows - r;
+      case Layout::TILED:
+        return std::min(tile - r%tile, rows - r);
+      default:
+        return 1;
+    }
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Class definition for PackedMatrix
+// Owns a copy of a row-major matrix converted to another layout; its view()
+// can be passed to the kernels any number of times.
+// ----------------------------------------------------------------------------
+
+template <typename T>
+class PackedMatrix {
+
+  public:
+
+    // m is rows x cols, row-major; tile is only used by Layout::TILED,
+    // where it must be > 0 (throws std::invalid_argument otherwise)
+    PackedMatrix(
+      size_t rows, size_t cols, const std::vector<T>& m,
+      Layout layout = Layout::COL_MAJOR, size_t tile = 16
+    ) :
+      rows{rows}, cols{cols}, layout{layout}, tile{layout == Layout::TILED ? tile : 0} {
+
+      if(layout == Layout::TILED && tile == 0) {
+        throw std::invalid_argument("PackedMatrix: a tiled layout needs a tile size > 0");
+      }
+      if(layout == Layout::TILED) {
+        data.assign((rows+tile-1)/tile*tile * ((cols+tile-1)/tile*tile), T{0});
+      }
+      else {
+        data.resize(rows*cols);
+      }
+      MatrixView<T> v = view();
+      for (size_t r = 0; r < rows; ++r) {
+        for (size_t c = 0; c < cols; ++c) {
+          data[v.index(r, c)] = m[r*cols + c];
+        }
+      }
+    }
+
+    MatrixView<T> view() const {
+      return {data.data(), rows, cols, layout, tile};
+    }
+
+  private:
+
+    size_t rows;
+    size_t cols;
+    Layout layout;
+    size_t tile;
+    std::vector<T> data;
+};
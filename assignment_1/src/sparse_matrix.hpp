@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Sparse matrices
+// CsrMatrix keeps the nonzeros of every row next to each other: those of
+// row i are values[row_ptr[i]:row_ptr[i+1]], in the columns col_idx[...]
+// of the same range. BsrMatrix does the same for dense b x b blocks: the
+// blocks of block row I are blocks row_ptr[I]:row_ptr[I+1], in the block
+// columns col_idx[...], each b*b values long and row-major; the blocks at
+// the bottom and right edges are padded with zeros. The kernels are in
+// matrix.hpp (matmul_parallel_csr, matvec_parallel_csr and the same for
+// BSR).
+// ----------------------------------------------------------------------------
+
+template <typename T>
+struct CsrMatrix {
+
+  size_t rows {0};
+  size_t cols {0};
+  std::vector<size_t> row_ptr {0};     // rows+1 offsets into col_idx and values
+  std::vector<size_t> col_idx;
+  std::vector<T> values;
+
+  size_t nnz() const {
+    return values.size();
+  }
+
+  // the nonzeros of the row-major rows x cols matrix m
+  static CsrMatrix from_dense(size_t rows, size_t cols, const std::vector<T>& m) {
+    CsrMatrix csr;
+    csr.rows = rows;
+    csr.cols = cols;
+    csr.row_ptr.reserve(rows+1);
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t j = 0; j < cols; ++j) {
+        if(m[i*cols + j] != T{0}) {
+          csr.col_idx.push_back(j);
+          csr.values.push_back(m[i*cols + j]);
+        }
+      }
+      csr.row_ptr.push_back(csr.values.size());
+    }
+    return csr;
+  }
+
+  // the row-major dense matrix
+  std::vector<T> to_dense() const {
+    std::vector<T> m(rows*cols, T{0});
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t e = row_ptr[i]; e < row_ptr[i+1]; ++e) {
+        m[i*cols + col_idx[e]] = values[e];
+      }
+    }
+    return m;
+  }
+};
+
+template <typename T>
+struct BsrMatrix {
+
+  size_t rows {0};
+  size_t cols {0};
+  size_t block {1};
+  std::vector<size_t> row_ptr {0};     // block rows+1 offsets into col_idx
+  std::vector<size_t> col_idx;         // block column of every block
+  std::vector<T> values;               // block*block values per block
+
+  size_t block_rows() const {
+    return (rows+block-1)/block;
+  }
+
+  // number of stored blocks
+  size_t blocks() const {
+    return col_idx.size();
+  }
+
+  // the b x b blocks of csr that hold at least one nonzero
+  static BsrMatrix from_csr(const CsrMatrix<T>& csr, size_t b) {
+    BsrMatrix bsr;
+    bsr.rows = csr.rows;
+    bsr.cols = csr.cols;
+    bsr.block = b;
+    size_t nb = bsr.block_rows();
+    size_t mb = (csr.cols+b-1)/b;
+    // slot of every block column in the block row being built, or mb
+    std::vector<size_t> slot(mb, mb);
+    for (size_t I = 0; I < nb; ++I) {
+      size_t first = bsr.col_idx.size();
+      for (size_t i = I*b; i < std::min(csr.rows, I*b+b); ++i) {
+        for (size_t e = csr.row_ptr[i]; e < csr.row_ptr[i+1]; ++e) {
+          size_t J = csr.col_idx[e] / b;
+          if(slot[J] == mb) {
+            slot[J] = bsr.col_idx.size() - first;
+            bsr.col_idx.push_back(J);
+            bsr.values.resize(bsr.values.size() + b*b, T{0});
+          }
+          bsr.values[(first + slot[J])*b*b + (i - I*b)*b + csr.col_idx[e] % b] = csr.values[e];
+        }
+      }
+      for (size_t s = first; s < bsr.col_idx.size(); ++s) {
+        slot[bsr.col_idx[s]] = mb;
+      }
+      bsr.row_ptr.push_back(bsr.col_idx.size());
+    }
+    return bsr;
+  }
+};
+
+// how the sparse kernels cut the rows of A into tasks
+enum class RowPartition {
+  ROWS,         // the same number of rows per task
+  NONZEROS      // about the same number of nonzeros per task
+};
+
+// cut the rows [0, row_ptr.size()-1) into at most parts ranges of about
+// the same cost, where a row costs its nonzeros plus one (so that empty
+// rows are not free); returns the parts+1 boundaries. A few dense rows
+// then get a range of their own instead of slowing down a whole share of
+// the rows
+inline std::vector<size_t> partition_by_nonzeros(const std::vector<size_t>& row_ptr, size_t parts) {
+  size_t rows = row_ptr.size() - 1;
+  parts = std::max<size_t>(1, std::min(parts, rows));
+  size_t total = row_ptr[rows] + rows;
+  std::vector<size_t> bounds {0};
+  for (size_t p = 1; p < parts; ++p) {
+    // first row whose cost up to it reaches p/parts of the total
+    size_t target = total * p / parts;
+    size_t lo = bounds.back(), hi = rows;
+    while(lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if(row_ptr[mid] + mid < target) {
+        lo = mid + 1;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    if(lo > bounds.back()) {
+      bounds.push_back(lo);
+    }
+  }
+  bounds.push_back(rows);
+  return bounds;
+}
+
+// cut the rows into at most parts ranges of the same number of rows
+inline std::vector<size_t> partition_by_rows(size_t rows, size_t parts) {
+  parts = std::max<size_t>(1, std::min(parts, rows));
+  std::vector<size_t> bounds;
+  for (size_t p = 0; p <= parts; ++p) {
+    bounds.push_back(rows * p / parts);
+  }
+  return bounds;
+}
+
+// the boundaries of the row ranges of a sparse matrix with row offsets
+// row_ptr (of rows or of block rows)
+inline std::vector<size_t> partition_rows(const std::vector<size_t>& row_ptr, size_t parts, RowPartition how) {
+  if(how == RowPartition::ROWS) {
+    return partition_by_rows(row_ptr.size() - 1, parts);
+  }
+  return partition_by_nonzeros(row_ptr, parts);
+}
+
+// a synthetic rows x cols matrix with a power-law degree distribution:
+// row i holds about nnz_per_row * rows * (i+1)^-alpha / H nonzeros (H
+// normalizes the total to nnz_per_row * rows), in uniformly drawn columns
+// with values in 1..4; the dense rows come first. Meant for benchmarks
+template <typename T>
+CsrMatrix<T> power_law_csr(size_t rows, size_t cols, double nnz_per_row, double alpha, unsigned seed = 1) {
+  double H = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    H += std::pow(static_cast<double>(i+1), -alpha);
+  }
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<size_t> col(0, cols ? cols-1 : 0);
+  std::uniform_int_distribution<int> value(1, 4);
+
+  CsrMatrix<T> csr;
+  csr.rows = rows;
+  csr.cols = cols;
+  std::vector<size_t> row;
+  std::vector<char> taken(cols, 0);
+  for (size_t i = 0; i < rows; ++i) {
+    double expected = nnz_per_row * rows * std::pow(static_cast<double>(i+1), -alpha) / H;
+    size_t degree = std::min(cols, static_cast<size_t>(std::llround(expected)));
+    row.clear();
+    if(degree * 2 > cols) {
+      // dense row: keep every column with probability degree/cols
+      std::bernoulli_distribution keep(static_cast<double>(degree) / cols);
+      for (size_t j = 0; j < cols; ++j) {
+        if(keep(gen)) {
+          row.push_back(j);
+        }
+      }
+    }
+    else {
+      while(row.size() < degree) {
+        size_t j = col(gen);
+        if(!taken[j]) {
+          taken[j] = 1;
+          row.push_back(j);
+        }
+      }
+      for (size_t j : row) {
+        taken[j] = 0;
+      }
+      std::sort(row.begin(), row.end());
+    }
+    for (size_t j : row) {
+      csr.col_idx.push_back(j);
+      csr.values.push_back(static_cast<T>(value(gen)));
+    }
+    csr.row_ptr.push_back(csr.values.size());
+  }
+  return csr;
+}
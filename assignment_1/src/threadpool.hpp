@@ -8,21 +8,23 @@
 #include <mutex>
 #include <condition_variable>
 #include <type_traits>
+#include <atomic>
+#include <random>
+#include <memory>
+#include "mpmc_queue.hpp"
+#include "work_stealing_queue.hpp"
+#include "task.hpp"
+#include "task_group.hpp"
+#include "idle_policy.hpp"
+#include "topology.hpp"
+#include "elastic_policy.hpp"
+#include "pool_stats.hpp"
+#include "tracer.hpp"
+#include "coroutine.hpp"
 
 #pragma once
 
 
-template <typename T>
-struct MoC {
-
-  MoC(T&& rhs) : object(std::move(rhs)) {}
-  MoC(const MoC& other) : object(std::move(other.object)) {}
-
-  T& get() { return object; }
-
-  mutable T object;
-};
-
 // ----------------------------------------------------------------------------
 // Class definition for Threadpool with centralized queue
 // ----------------------------------------------------------------------------
@@ -32,34 +34,70 @@ class Threadpool_C {
   public:
     
     // constructor tasks a unsigned integer representing the number of
-    // workers you need
-    Threadpool_C(size_t N) {
+    // workers you need, and optionally the capacity of a lock-free ring
+    // buffer used in front of the locked queue (0 disables the ring),
+    // how long an idle worker spins before it parks and how the workers
+    // are pinned to cpus
+    Threadpool_C(size_t N, size_t ring_capacity = 0, IdlePolicy idle_policy = {},
+                 Placement placement = Placement::NONE) : idle{idle_policy}, recorder(N) {
+
+      auto cpus = topology::place(placement, N);
+
+      if (ring_capacity > 0) {
+        ring = std::make_unique<MPMCQueue<Task>>(ring_capacity);
+      }
 
       for (size_t i = 0; i < N; i++) {
 
-        threads.emplace_back([this](){
+        threads.emplace_back([this, i](){
+          Tracer::set_worker(i);
           // keep doing my job until the main thread sends a stop signal
           while(!stop) {
-            std::function<void()> task;
-            // my job is to iteratively grab a task from the queue
-            {
+            auto since = recorder.now();
+            Task task;
+            // my job is to iteratively grab a task from the ring first
+            // and fall back to the locked queue when the ring is empty;
+            // with nothing in sight, spin for a while before parking
+            if(!ring || !ring->try_pop(task)) {
+              idle.spin_until([this](){ return has_work(); });
+            }
+            if(!task && (!ring || !ring->try_pop(task))) {
               // Best practice: anything that happens inside the while continuation check
               // should always be protected by lock
               std::unique_lock lock(mtx);
               while(queue.empty() && !stop) {
+                // announce myself before the last look at the ring so that
+                // a concurrent push either sees me or I see the pushed task
+                sleeping.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(ring && !ring->empty()) {
+                  sleeping.fetch_sub(1);
+                  break;
+                }
                 cv.wait(lock);
+                sleeping.fetch_sub(1);
+                recorder.wakeup(i);
               }
               if(!queue.empty()) {
-                task = queue.front();
+                task = std::move(queue.front());
                 queue.pop();
+                queued.store(queue.size(), std::memory_order_relaxed);
               }
             }
+            recorder.idle_done(i, since);
             // and run the task...
             if(task) {
-              task();
+              // the depth of the locked queue, the ring does not track its size
+              recorder.queue_depth(i, [this](){ return queued.load(std::memory_order_relaxed) + 1; });
+              since = recorder.now();
+              run_traced(task);
+              recorder.task_done(i, since);
             }
           }
         });
+        if(!cpus.empty()) {
+          topology::pin(threads.back(), cpus[i].cpu);
+        }
       }
     }
 
@@ -83,36 +121,167 @@ class Threadpool_C {
     auto insert(C&& task) {
       std::promise<void> promise;
       auto fu = promise.get_future();
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        }
+      );
+      return fu;
+    }
+
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
+
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker
+    auto schedule() {
+      return ScheduleAwaiter<Threadpool_C>(*this);
+    }
+#endif
+
+    // insert a task without creating a future for it
+    template <typename C>
+    void silent_insert(C&& task) {
+      Task t(std::forward<C>(task));
+      // lock-free fast path, only wake up a worker if someone is parked
+      if(ring && ring->try_push(std::move(t))) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleeping.load() > 0) {
+          std::scoped_lock lock(mtx);
+          cv.notify_one();
+        }
+        return;
+      }
+      // the ring is full or disabled
+      bool wake;
       {
         std::scoped_lock lock(mtx);
-        queue.push(
-          [moc=MoC{std::move(promise)}, task=std::forward<C>(task)] () mutable {
-            task();
-            moc.object.set_value();
-          }
-        );
+        queue.push(std::move(t));
+        queued.store(queue.size(), std::memory_order_relaxed);
+        wake = sleeping.load() > 0;
       }
-      cv.notify_one();
+      if(wake) {
+        cv.notify_one();
+      }
+    }
+
+    // insert n tasks fn(0), ..., fn(n-1) under a single lock and wake up
+    // as many workers as there are tasks; the returned future becomes
+    // ready once all of them have finished
+    template <typename F>
+    std::future<void> insert_range(size_t n, F&& fn) {
+      auto state = new RangeState<std::decay_t<F>>(n, std::forward<F>(fn));
+      auto fu = state->promise.get_future();
+      push_range(state, n);
       return fu;
     }
+
+    // insert n tasks fn(0), ..., fn(n-1) as one member of a task group
+    template <typename F>
+    void insert_range(TaskGroup& group, size_t n, F&& fn) {
+      push_range(new RangeState<std::decay_t<F>>(n, std::forward<F>(fn), &group), n);
+    }
+
+    // run one queued task on the calling thread, returns false if there
+    // was nothing to run
+    bool run_one() {
+      Task task;
+      if(!ring || !ring->try_pop(task)) {
+        std::scoped_lock lock(mtx);
+        if(queue.empty()) {
+          return false;
+        }
+        task = std::move(queue.front());
+        queue.pop();
+        queued.store(queue.size(), std::memory_order_relaxed);
+      }
+      run_traced(task);
+      return true;
+    }
+
+    // wait for a task group while helping the workers: the caller runs
+    // queued tasks until the queue drains and only then blocks, so a task
+    // may itself insert into this pool and wait without deadlocking it
+    void wait(TaskGroup& group) {
+      while(group.size() > 0 && run_one()) {
+      }
+      group.wait();
+    }
+
+    // number of workers
+    size_t num_workers() const {
+      return threads.size();
+    }
+
+    // snapshot of the per-worker counters (empty unless THREADPOOL_STATS)
+    PoolStats stats() const {
+      return recorder.snapshot();
+    }
     
 
   private:
 
+    // whether a spinning worker should go for the queues
+    bool has_work() const {
+      return stop || queued.load(std::memory_order_relaxed) > 0 || (ring && !ring->empty());
+    }
+
+    template <typename S>
+    void push_range(S* state, size_t n) {
+      if(n == 0) {
+        state->finish();
+        return;
+      }
+      // wake up as many parked workers as there are tasks
+      size_t wake;
+      {
+        std::scoped_lock lock(mtx);
+        for (size_t i = 0; i < n; ++i) {
+          queue.emplace([state, i](){ state->run(i); });
+        }
+        queued.store(queue.size(), std::memory_order_relaxed);
+        wake = std::min(n, sleeping.load());
+      }
+      for (size_t w = 0; w < wake; ++w) {
+        cv.notify_one();
+      }
+    }
+
     std::mutex mtx;
     std::vector<std::thread> threads;
     std::condition_variable cv;
     
-    bool stop {false};
-    std::queue< std::function<void()> > queue;
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> sleeping {0};
+    std::atomic<size_t> queued {0};
+    std::queue<Task> queue;
+    std::unique_ptr<MPMCQueue<Task>> ring;
+    IdlePolicy idle;
+    StatsRecorder<> recorder;
 
 };
 
 
+// how Threadpool_D picks the queue of an inserted task
+enum class Balance {
+  ROUND_ROBIN,    // the next queue in turn, regardless of its load
+  TWO_CHOICES,    // the less loaded of two random queues
+  LEAST_LOADED    // the least loaded queue, scanning all of them
+};
+
 // ----------------------------------------------------------------------------
 // Class definition for Threadpool with decentralized queue
 // Every thread has its own local queue
-// Main thread push tasks into a queue in a round robin manner
+// Main thread push tasks into a queue in a round robin manner, or by the
+// load of the queues (queued plus running tasks, see Balance)
 // ----------------------------------------------------------------------------
 
 class Threadpool_D {
@@ -120,33 +289,68 @@ class Threadpool_D {
   public:
     
     // constructor tasks a unsigned integer representing the number of
-    // workers you need
-    Threadpool_D(size_t N): number_threads{N}, mtxs(N), cvs(N), queues(N) {
+    // workers you need, and optionally how long an idle worker spins
+    // before it parks and how the workers are pinned to cpus
+    // With a placement, every NUMA node gets its own round robin over
+    // the workers pinned to it (see silent_insert_on); balance picks the
+    // queue of every inserted task
+    Threadpool_D(size_t N, IdlePolicy idle_policy = {}, Placement placement = Placement::NONE,
+                 Balance balance = Balance::ROUND_ROBIN):
+      number_threads{N}, mtxs(N), cvs(N), queues(N), sizes(N), loads(N), parked(N),
+      idle{idle_policy}, balance{balance}, recorder(N) {
+
+      auto cpus = topology::place(placement, N);
+      for (size_t i = 0; i < cpus.size(); ++i) {
+        size_t node = static_cast<size_t>(cpus[i].node);
+        if(node >= node_workers.size()) {
+          node_workers.resize(node+1);
+        }
+        node_workers[node].push_back(i);
+      }
+      node_turns = std::vector<std::atomic<size_t>>(node_workers.size());
 
       for (size_t i = 0; i < N; i++) {
         threads.emplace_back([this, i](){
+          Tracer::set_worker(i);
           // keep doing my job until the main thread sends a stop signal
           while(!stop) {
-            std::function<void()> task;
+            auto since = recorder.now();
+            Task task;
+            // with an empty queue, spin for a while before parking
+            idle.spin_until([this, i](){
+              return stop || sizes[i].load(std::memory_order_relaxed) > 0;
+            });
             // my job is to iteratively grab a task from the queue
             {
               // Best practice: anything that happens inside the while continuation check
               // should always be protected by lock
               std::unique_lock lock(mtxs[i]);
               while(queues[i].empty() && !stop) {
+                parked[i] = true;
                 cvs[i].wait(lock);
+                parked[i] = false;
+                recorder.wakeup(i);
               }
               if(!queues[i].empty()) {
-                task = queues[i].front();
+                recorder.queue_depth(i, [this, i](){ return queues[i].size(); });
+                task = std::move(queues[i].front());
                 queues[i].pop();
+                sizes[i].store(queues[i].size(), std::memory_order_relaxed);
               }
             }
+            recorder.idle_done(i, since);
             // and run the task...
             if(task) {
-              task();
+              since = recorder.now();
+              run_traced(task);
+              recorder.task_done(i, since);
+              loads[i].fetch_sub(1, std::memory_order_relaxed);
             }
           }
         });
+        if(!cpus.empty()) {
+          topology::pin(threads.back(), cpus[i].cpu);
+        }
       }
     }
 
@@ -160,10 +364,12 @@ class Threadpool_D {
 
     // shutdown the threadpool
     void shutdown() {
-      //std::scoped_lock lock(mtx);
       stop = true;
 
+      // a worker that has just seen stop == false under its lock must be
+      // waiting before we notify it, otherwise the wakeup is lost
       for (size_t i = 0; i < number_threads; ++i) {
+        std::scoped_lock lock(mtxs[i]);
         cvs[i].notify_one();
       }
     }
@@ -171,36 +377,701 @@ class Threadpool_D {
     // insert a task "callable object" into the threadpool
     template <typename C>
     auto insert(C&& task) {
-      
       std::promise<void> promise;
       auto fu = promise.get_future();
-      
-      {
-        std::scoped_lock lock(mtxs[turn]);
-        queues[turn].push(
-          [moc=MoC{std::move(promise)}, task=std::forward<C>(task)] () mutable {
-            task();
-            moc.object.set_value();
-          }
-        );
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        }
+      );
+      return fu;
+    }
+
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
+
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker
+    auto schedule() {
+      return ScheduleAwaiter<Threadpool_D>(*this);
+    }
+#endif
+
+    // insert a task without creating a future for it
+    template <typename C>
+    void silent_insert(C&& task) {
+      push(pick(number_threads, [](size_t k){ return k; }), std::forward<C>(task));
+    }
+
+    // insert a task without creating a future for it into the queue of a
+    // worker pinned to the given NUMA node, so that it runs close to the
+    // data that node owns; falls back to silent_insert if no worker is
+    // pinned to that node
+    template <typename C>
+    void silent_insert_on(size_t node, C&& task) {
+      if(node >= node_workers.size() || node_workers[node].empty()) {
+        silent_insert(std::forward<C>(task));
+        return;
       }
+      auto& workers = node_workers[node];
+      push(pick(workers.size(), [&workers](size_t k){ return workers[k]; }, &node_turns[node]),
+           std::forward<C>(task));
+    }
 
-      cvs[turn].notify_one();
+    // insert a task on the given NUMA node and attach it to a task group
+    template <typename C>
+    void insert_on(size_t node, TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert_on(node, [&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
 
-      turn = (turn+1)%number_threads;
-      
+    // number of NUMA nodes with workers pinned to them (0 without placement)
+    size_t num_nodes() const {
+      return node_workers.size();
+    }
+
+    // insert n tasks fn(0), ..., fn(n-1) cut into one contiguous chunk per
+    // worker; every chunk goes to the queue balance picks, under a single
+    // lock; the returned future becomes ready once all of them have finished
+    template <typename F>
+    std::future<void> insert_range(size_t n, F&& fn) {
+      auto state = new RangeState<std::decay_t<F>>(n, std::forward<F>(fn));
+      auto fu = state->promise.get_future();
+      push_range(state, n);
       return fu;
     }
+
+    // insert n tasks fn(0), ..., fn(n-1) as one member of a task group
+    template <typename F>
+    void insert_range(TaskGroup& group, size_t n, F&& fn) {
+      push_range(new RangeState<std::decay_t<F>>(n, std::forward<F>(fn), &group), n);
+    }
+
+    // run one queued task from any of the queues on the calling thread,
+    // returns false if there was nothing to run
+    bool run_one() {
+      for (size_t w = 0; w < number_threads; ++w) {
+        Task task;
+        {
+          std::scoped_lock lock(mtxs[w]);
+          if(queues[w].empty()) {
+            continue;
+          }
+          task = std::move(queues[w].front());
+          queues[w].pop();
+          sizes[w].store(queues[w].size(), std::memory_order_relaxed);
+        }
+        run_traced(task);
+        loads[w].fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+      return false;
+    }
+
+    // wait for a task group while helping the workers: the caller runs
+    // queued tasks until all queues drain and only then blocks, so a task
+    // may itself insert into this pool and wait without deadlocking it
+    void wait(TaskGroup& group) {
+      while(group.size() > 0 && run_one()) {
+      }
+      group.wait();
+    }
+
+    // number of workers
+    size_t num_workers() const {
+      return number_threads;
+    }
+
+    // snapshot of the per-worker counters (empty unless THREADPOOL_STATS)
+    PoolStats stats() const {
+      return recorder.snapshot();
+    }
   
     
   private:
 
+    // pick the queue of a task among n workers, worker(k) being the k-th
+    // of them; the loads are read without locks, so concurrent inserters
+    // may pick the same queue, which only costs some balance
+    template <typename W>
+    size_t pick(size_t n, W&& worker, std::atomic<size_t>* rr = nullptr) {
+      // tasks may insert too, so claim the turn atomically
+      size_t first = (rr ? *rr : turn).fetch_add(1, std::memory_order_relaxed)%n;
+      if(balance == Balance::ROUND_ROBIN || n == 1) {
+        return worker(first);
+      }
+      auto load = [this](size_t q){ return loads[q].load(std::memory_order_relaxed); };
+      if(balance == Balance::TWO_CHOICES) {
+        thread_local std::mt19937 rng{std::random_device{}()};
+        // two distinct queues: b is a plus 1..n-1
+        size_t ka = std::uniform_int_distribution<size_t>(0, n-1)(rng);
+        size_t kb = (ka + 1 + std::uniform_int_distribution<size_t>(0, n-2)(rng))%n;
+        size_t a = worker(ka), b = worker(kb);
+        return load(b) < load(a) ? b : a;
+      }
+      // least loaded, ties broken in turn
+      size_t best = worker(first);
+      for (size_t k = 1; k < n && load(best) > 0; ++k) {
+        size_t q = worker((first+k)%n);
+        if(load(q) < load(best)) {
+          best = q;
+        }
+      }
+      return best;
+    }
+
+    // push a task into the queue of worker q
+    template <typename C>
+    void push(size_t q, C&& task) {
+      loads[q].fetch_add(1, std::memory_order_relaxed);
+      // only a parked worker needs a wakeup
+      bool wake;
+      {
+        std::scoped_lock lock(mtxs[q]);
+        queues[q].emplace(std::forward<C>(task));
+        sizes[q].store(queues[q].size(), std::memory_order_relaxed);
+        wake = parked[q];
+      }
+
+      if(wake) {
+        cvs[q].notify_one();
+      }
+    }
+
+    template <typename S>
+    void push_range(S* state, size_t n) {
+      if(n == 0) {
+        state->finish();
+        return;
+      }
+      for (size_t w = 0; w < number_threads; ++w) {
+        size_t beg = w*n/number_threads;
+        size_t end = (w+1)*n/number_threads;
+        if(beg == end) {
+          continue;
+        }
+        // the load of a chunk is counted before the next pick sees it
+        size_t q = pick(number_threads, [](size_t k){ return k; });
+        loads[q].fetch_add(end-beg, std::memory_order_relaxed);
+        bool wake;
+        {
+          std::scoped_lock lock(mtxs[q]);
+          for (size_t i = beg; i < end; ++i) {
+            queues[q].emplace([state, i](){ state->run(i); });
+          }
+          sizes[q].store(queues[q].size(), std::memory_order_relaxed);
+          wake = parked[q];
+        }
+        if(wake) {
+          cvs[q].notify_one();
+        }
+      }
+    }
+
     size_t number_threads; 
-    size_t turn{0};
+    std::atomic<size_t> turn{0};
     std::vector<std::mutex> mtxs;
     std::vector<std::thread> threads;
     std::vector<std::condition_variable> cvs;
-    bool stop {false};
-    std::vector<std::queue<std::function<void()>>> queues;
+    std::atomic<bool> stop {false};
+    std::vector<std::queue<Task>> queues;
+    std::vector<std::atomic<size_t>> sizes;   // queue sizes, readable without the lock
+    std::vector<std::atomic<size_t>> loads;   // queued plus running tasks per worker
+    std::vector<std::atomic<bool>> parked;    // guarded by mtxs
+    IdlePolicy idle;
+    Balance balance;
+    std::vector<std::vector<size_t>> node_workers;
+    std::vector<std::atomic<size_t>> node_turns;
+    StatsRecorder<> recorder;
+
+};
+
+
+
+// ----------------------------------------------------------------------------
+// Class definition for Threadpool with work-stealing queues
+// Every thread owns a lock-free deque and steals from random victims
+// when its own deque runs dry
+// Tasks inserted from outside the pool go to a shared queue, from which
+// a worker grabs a batch into its deque so that the others can steal it
+// ----------------------------------------------------------------------------
+
+class Threadpool_W {
+
+  public:
+    
+    // constructor tasks a unsigned integer representing the number of
+    // workers you need, and optionally how long an idle worker spins
+    // before it parks and how the workers are pinned to cpus
+    Threadpool_W(size_t N, IdlePolicy idle_policy = {}, Placement placement = Placement::NONE):
+      number_threads{N}, queues(N), idle{idle_policy}, recorder(N) {
+
+      auto cpus = topology::place(placement, N);
+
+      for (size_t i = 0; i < N; i++) {
+        threads.emplace_back([this, i](){
+          
+          worker_pool = this;
+          worker_id   = i;
+          Tracer::set_worker(i);
+
+          std::mt19937 rng(static_cast<unsigned>(i) + 1);
+          
+          // keep doing my job until the main thread sends a stop signal
+          while(!stop) {
+            auto since = recorder.now();
+            // my own deque first, then the others, then the shared queue
+            Task* task = queues[i].pop();
+            if(!task && (task = steal(i, rng))) {
+              recorder.steal(i);
+            }
+            // spin for a while before going for the shared queue and parking
+            if(!task && idle.spin_until([this](){ return has_work(); }) && stealable()) {
+              continue;
+            }
+            if(!task) {
+              task = grab(i);
+            }
+            recorder.idle_done(i, since);
+            // and run the task...
+            if(task) {
+              recorder.queue_depth(i, [this, i](){
+                return queues[i].size() + queued.load(std::memory_order_relaxed) + 1;
+              });
+              since = recorder.now();
+              run_traced(*task);
+              delete task;
+              recorder.task_done(i, since);
+            }
+          }
+        });
+        if(!cpus.empty()) {
+          topology::pin(threads.back(), cpus[i].cpu);
+        }
+      }
+    }
+
+    // destructor will release all threading resources by joining all of them
+    ~Threadpool_W() {
+      // I need to join the threads to release their resources
+      for(auto& t : threads) {
+        t.join();
+      }
+
+      // release the tasks that never got a chance to run
+      while(!queue.empty()) {
+        delete queue.front();
+        queue.pop();
+      }
+      for(auto& q : queues) {
+        while(auto task = q.pop()) {
+          delete task;
+        }
+      }
+    }
+
+    // shutdown the threadpool
+    void shutdown() {
+      {
+        std::scoped_lock lock(mtx);
+        stop = true;
+      }
+      cv.notify_all();
+    }
+
+    // insert a task "callable object" into the threadpool
+    template <typename C>
+    auto insert(C&& task) {
+      std::promise<void> promise;
+      auto fu = promise.get_future();
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        }
+      );
+      return fu;
+    }
+
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
+
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker
+    auto schedule() {
+      return ScheduleAwaiter<Threadpool_W>(*this);
+    }
+#endif
+
+    // insert a task without creating a future for it
+    template <typename C>
+    void silent_insert(C&& task) {
+      // the deques hold pointers, so the task itself lives on the heap
+      auto t = new Task(std::forward<C>(task));
+
+      // a worker of this pool pushes to its own deque
+      if(worker_pool == this) {
+        queues[worker_id].push(t);
+        wake_one();
+      }
+      else {
+        bool wake;
+        {
+          std::scoped_lock lock(mtx);
+          queue.push(t);
+          queued.store(queue.size(), std::memory_order_relaxed);
+          wake = sleeping.load() > 0;
+        }
+        if(wake) {
+          cv.notify_one();
+        }
+      }
+    }
+  
+
+    // run one queued task on the calling thread, returns false if there
+    // was nothing to run; a worker of this pool looks at its own deque first
+    bool run_one() {
+      Task* task {nullptr};
+      if(worker_pool == this) {
+        task = queues[worker_id].pop();
+      }
+      for (size_t v = 0; v < number_threads && !task; ++v) {
+        task = queues[v].steal();
+      }
+      if(!task) {
+        std::scoped_lock lock(mtx);
+        if(queue.empty()) {
+          return false;
+        }
+        task = queue.front();
+        queue.pop();
+        queued.store(queue.size(), std::memory_order_relaxed);
+      }
+      run_traced(*task);
+      delete task;
+      return true;
+    }
 
+    // wait for a task group while helping the workers: the caller runs
+    // queued tasks until all queues drain and only then blocks, so a task
+    // may itself insert into this pool and wait without deadlocking it
+    void wait(TaskGroup& group) {
+      while(group.size() > 0 && run_one()) {
+      }
+      group.wait();
+    }
+
+    // number of workers
+    size_t num_workers() const {
+      return number_threads;
+    }
+
+    // snapshot of the per-worker counters (empty unless THREADPOOL_STATS)
+    PoolStats stats() const {
+      return recorder.snapshot();
+    }
+
+  private:
+
+    // try to steal a task from random victims
+    Task* steal(size_t i, std::mt19937& rng) {
+      std::uniform_int_distribution<size_t> dist(0, number_threads-1);
+      for (size_t r = 0; r < 2*number_threads; ++r) {
+        size_t v = dist(rng);
+        if(v == i) {
+          continue;
+        }
+        if(auto task = queues[v].steal(); task) {
+          // there is more to steal, let another idle worker join
+          if(!queues[v].empty()) {
+            wake_one();
+          }
+          return task;
+        }
+      }
+      return nullptr;
+    }
+
+    // grab a batch of tasks from the shared queue into my deque, or park
+    // until something is inserted; returns nullptr if some deque may have
+    // become stealable in the meantime
+    Task* grab(size_t i) {
+      Task* task {nullptr};
+      size_t batch {0};
+      {
+        std::unique_lock lock(mtx);
+        while(!stop) {
+          if(!queue.empty()) {
+            task = std::move(queue.front());
+            queue.pop();
+            batch = std::min(queue.size(), queue.size()/number_threads + 1);
+            for (size_t b = 0; b < batch; ++b) {
+              queues[i].push(queue.front());
+              queue.pop();
+            }
+            queued.store(queue.size(), std::memory_order_relaxed);
+            break;
+          }
+          // announce myself before the last look at the deques so that
+          // a concurrent push either sees me or I see the pushed task
+          sleeping.fetch_add(1);
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if(stealable()) {
+            sleeping.fetch_sub(1);
+            break;
+          }
+          cv.wait(lock);
+          sleeping.fetch_sub(1);
+          recorder.wakeup(i);
+        }
+      }
+      if(batch > 0) {
+        wake_one();
+      }
+      return task;
+    }
+
+    // whether a spinning worker should go for the queues
+    bool has_work() const {
+      return stop || queued.load(std::memory_order_relaxed) > 0 || stealable();
+    }
+
+    bool stealable() const {
+      for(auto& q : queues) {
+        if(!q.empty()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // wake up one parked worker, if any
+    void wake_one() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(sleeping.load() > 0) {
+        std::scoped_lock lock(mtx);
+        cv.notify_one();
+      }
+    }
+
+    size_t number_threads;
+    std::mutex mtx;
+    std::vector<std::thread> threads;
+    std::condition_variable cv;
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> sleeping {0};
+    std::atomic<size_t> queued {0};
+    std::queue<Task*> queue;
+    std::vector<WorkStealingQueue<Task*>> queues;
+    IdlePolicy idle;
+    StatsRecorder<> recorder;
+
+    inline static thread_local Threadpool_W* worker_pool {nullptr};
+    inline static thread_local size_t worker_id {0};
+};
+
+
+// ----------------------------------------------------------------------------
+// Class definition for Threadpool with centralized queue and an elastic
+// number of workers
+// Workers are added by the inserting thread (or by a worker that picked a
+// task that waited too long) and retire themselves after an idle timeout;
+// a retired worker's thread is joined when its slot is reused or when the
+// pool is destroyed
+// ----------------------------------------------------------------------------
+
+class Threadpool_E {
+
+  using clock = std::chrono::steady_clock;
+
+  public:
+
+    // constructor takes the elastic policy: the pool starts with
+    // policy.min_workers workers and never grows beyond policy.limit()
+    explicit Threadpool_E(ElasticPolicy elastic_policy = {}) : policy{elastic_policy} {
+      std::scoped_lock lock(mtx);
+      for (size_t i = 0; i < policy.min_workers; i++) {
+        spawn();
+      }
+    }
+
+    // destructor will release all threading resources by joining all of
+    // them, the retired ones included
+    ~Threadpool_E() {
+      for(auto& t : threads) {
+        if(t.joinable()) {
+          t.join();
+        }
+      }
+    }
+
+    // shutdown the threadpool
+    void shutdown() {
+      std::scoped_lock lock(mtx);
+      stop = true;
+      cv.notify_all();
+    }
+
+    // insert a task "callable object" into the threadpool
+    template <typename C>
+    auto insert(C&& task) {
+      std::promise<void> promise;
+      auto fu = promise.get_future();
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        }
+      );
+      return fu;
+    }
+
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
+
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker
+    auto schedule() {
+      return ScheduleAwaiter<Threadpool_E>(*this);
+    }
+#endif
+
+    // insert a task without creating a future for it; wakes up an idle
+    // worker if there is one and grows the pool if the queue got too deep
+    // for the live workers (woken workers may not have caught up yet)
+    template <typename C>
+    void silent_insert(C&& task) {
+      bool wake;
+      {
+        std::scoped_lock lock(mtx);
+        queue.emplace(Task(std::forward<C>(task)),
+                      policy.max_wait.count() > 0 ? clock::now() : clock::time_point{});
+        wake = sleeping > 0;
+        if(queue.size() > policy.queue_depth*live) {
+          spawn();
+        }
+      }
+      if(wake) {
+        cv.notify_one();
+      }
+    }
+
+    // run one queued task on the calling thread, returns false if there
+    // was nothing to run
+    bool run_one() {
+      Task task;
+      {
+        std::scoped_lock lock(mtx);
+        if(queue.empty()) {
+          return false;
+        }
+        task = std::move(queue.front().first);
+        queue.pop();
+      }
+      run_traced(task);
+      return true;
+    }
+
+    // wait for a task group while helping the workers
+    void wait(TaskGroup& group) {
+      while(group.size() > 0 && run_one()) {
+      }
+      group.wait();
+    }
+
+    // number of live workers
+    size_t num_workers() {
+      std::scoped_lock lock(mtx);
+      return live;
+    }
+
+  private:
+
+    // start one more worker unless the pool is at its limit; the caller
+    // holds the lock
+    void spawn() {
+      if(stop || live >= policy.limit()) {
+        return;
+      }
+      size_t slot = threads.size();
+      if(!retired.empty()) {
+        // the retired worker has released the lock for good, so it is
+        // about to return (if it has not already)
+        slot = retired.back();
+        retired.pop_back();
+        threads[slot].join();
+        threads[slot] = std::thread([this, slot](){ work(slot); });
+      }
+      else {
+        threads.emplace_back([this, slot](){ work(slot); });
+      }
+      ++live;
+    }
+
+    void work(size_t slot) {
+      Tracer::set_worker(slot);
+      std::unique_lock lock(mtx);
+      // keep doing my job until the main thread sends a stop signal
+      while(!stop) {
+        if(queue.empty()) {
+          ++sleeping;
+          bool timeout = cv.wait_for(lock, policy.idle_timeout) == std::cv_status::timeout;
+          --sleeping;
+          // retire if I was idle for a whole timeout and there are more
+          // workers than the minimum
+          if(timeout && queue.empty() && !stop && live > policy.min_workers) {
+            --live;
+            retired.push_back(slot);
+            return;
+          }
+          continue;
+        }
+        auto [task, since] = std::move(queue.front());
+        queue.pop();
+        // the task waited too long: the workers cannot keep up
+        if(policy.max_wait.count() > 0 && clock::now() - since > policy.max_wait) {
+          spawn();
+        }
+        // and run the task...
+        lock.unlock();
+        run_traced(task);
+        lock.lock();
+      }
+    }
+
+    ElasticPolicy policy;
+    std::mutex mtx;
+    std::vector<std::thread> threads;
+    std::vector<size_t> retired;             // slots of retired workers
+    std::condition_variable cv;
+    bool stop {false};                       // guarded by mtx
+    size_t live {0};                         // guarded by mtx
+    size_t sleeping {0};                     // guarded by mtx
+    std::queue<std::pair<Task, clock::time_point>> queue;
 };
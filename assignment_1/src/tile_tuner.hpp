@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Class definition for TileTuner
+// Picks the tile size of a blocked kernel per shape and per machine: the
+// first time a key is asked for, every candidate is timed and the fastest
+// one is kept. Results are persisted to a cache file (MATMUL_TILE_CACHE,
+// or matmul_tiles.cache in the working directory) and read back by later
+// runs, so a key is only tuned once per machine. Entries of other
+// machines in the same file are kept but never used.
+// ----------------------------------------------------------------------------
+
+class TileTuner {
+
+  public:
+
+    inline static const std::vector<size_t> default_candidates {8, 16, 32, 64, 128};
+
+    // the process-wide tuner
+    static TileTuner& instance() {
+      static TileTuner tuner(default_path());
+      return tuner;
+    }
+
+    explicit TileTuner(std::string path) : path{std::move(path)}, machine{machine_id()} {
+      load();
+    }
+
+    // the tile size for key; on a miss, time(t) is called for every
+    // candidate t and must return the seconds that tile size took. The
+    // lock is not held while timing, so a tuned kernel may run on a pool
+    // whose tasks use the tuner too.
+    template <typename F>
+    size_t tile(const std::string& key, F&& time,
+                const std::vector<size_t>& candidates = default_candidates) {
+      {
+        std::scoped_lock lock(mtx);
+        if(auto it = tiles.find(key); it != tiles.end()) {
+          return it->second;
+        }
+      }
+
+      size_t best = candidates.front();
+      double best_time = std::numeric_limits<double>::max();
+      for (size_t t : candidates) {
+        // best of two runs, the first one may pay for cold caches
+        double s = std::min(time(t), time(t));
+        if(s < best_time) {
+          best_time = s;
+          best = t;
+        }
+      }
+
+      std::scoped_lock lock(mtx);
+      if(tiles.emplace(key, best).second) {
+        std::ofstream os(path, std::ios::app);
+        os << machine << ' ' << key << ' ' << best << '\n';
+      }
+      return tiles[key];
+    }
+
+    // seconds taken by fn()
+    template <typename F>
+    static double measure(F&& fn) {
+      auto beg = std::chrono::steady_clock::now();
+      fn();
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+    }
+
+  private:
+
+    static std::string default_path() {
+      const char* env = std::getenv("MATMUL_TILE_CACHE");
+      return env ? env : "matmul_tiles.cache";
+    }
+
+    // the cpu model and the number of hardware threads, without spaces
+    static std::string machine_id() {
+      std::string model = "unknown";
+      std::ifstream is("/proc/cpuinfo");
+      for (std::string line; std::getline(is, line); ) {
+        if(line.rfind("model name", 0) == 0) {
+          model = line.substr(line.find(':') + 2);
+          break;
+        }
+      }
+      std::string id;
+      for (char c : model) {
+        id += (c == ' ' || c == '\t') ? '_' : c;
+      }
+      return id + "/" + std::to_string(std::thread::hardware_concurrency());
+    }
+
+    // lines are "<machine> <key> <tile>"; the last entry of a key wins
+    void load() {
+      std::ifstream is(path);
+      for (std::string line; std::getline(is, line); ) {
+        std::istringstream ls(line);
+        std::string m, key;
+        size_t t;
+        if(ls >> m >> key >> t && m == machine && t > 0) {
+          tiles[key] = t;
+        }
+      }
+    }
+
+    std::mutex mtx;
+    std::string path;
+    std::string machine;
+    std::unordered_map<std::string, size_t> tiles;
+};
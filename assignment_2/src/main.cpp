@@ -1,6 +1,7 @@
 #include <iostream>
 #include <chrono>
 #include <vector>
+#include <string>
 #include "parallel_library.hpp"
 #include "benchmark/benchmark.h"
 
@@ -276,8 +277,583 @@ BENCHMARK(benchmark_parallel_reduce_guided)
   ->Unit(benchmark::kMillisecond);
 
 
+// back-to-back small reductions, where the wakeup latency of the workers
+// dominates; the fourth argument turns on spinning before parking
+static void benchmark_parallel_reduce_static_idle(benchmark::State& s) {
+  size_t counts = s.range(0);
+
+  std::vector<int> vec(counts);
+  for (auto& v : vec) {
+    v = ::rand()%10;
+  }
+
+  IdlePolicy idle;
+  if (s.range(3)) {
+    idle.spins  = 4096;
+    idle.yields = 64;
+  }
+
+  Threadpool threadpool(s.range(1), 0, idle);
+  size_t chunk_size = s.range(2);
+ 
+  // Timing loop
+  for (auto _ : s) {
+    int r = par_reduce_static(vec, 100, chunk_size, threadpool);
+    benchmark::DoNotOptimize(r);
+  }
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_parallel_reduce_static_idle)
+  ->Args({10,1,64,0})
+  ->Args({100,1,64,0})
+  ->Args({1000,1,64,0})
+  ->Args({10000,1,64,0})
+  ->Args({100000,1,64,0})
+  ->Args({10,2,64,0})
+  ->Args({100,2,64,0})
+  ->Args({1000,2,64,0})
+  ->Args({10000,2,64,0})
+  ->Args({100000,2,64,0})
+  ->Args({10,4,64,0})
+  ->Args({100,4,64,0})
+  ->Args({1000,4,64,0})
+  ->Args({10000,4,64,0})
+  ->Args({100000,4,64,0})
+  ->Args({10,8,64,0})
+  ->Args({100,8,64,0})
+  ->Args({1000,8,64,0})
+  ->Args({10000,8,64,0})
+  ->Args({100000,8,64,0})
+  ->Args({10,1,64,1})
+  ->Args({100,1,64,1})
+  ->Args({1000,1,64,1})
+  ->Args({10000,1,64,1})
+  ->Args({100000,1,64,1})
+  ->Args({10,2,64,1})
+  ->Args({100,2,64,1})
+  ->Args({1000,2,64,1})
+  ->Args({10000,2,64,1})
+  ->Args({100000,2,64,1})
+  ->Args({10,4,64,1})
+  ->Args({100,4,64,1})
+  ->Args({1000,4,64,1})
+  ->Args({10000,4,64,1})
+  ->Args({100000,4,64,1})
+  ->Args({10,8,64,1})
+  ->Args({100,8,64,1})
+  ->Args({1000,8,64,1})
+  ->Args({10000,8,64,1})
+  ->Args({100000,8,64,1})
+  ->UseRealTime()
+  ->Unit(benchmark::kMicrosecond);
+
+
+// parallel reduction with recursive fork-join splitting
+static void benchmark_parallel_reduce_fork_join(benchmark::State& s) {
+  size_t counts = s.range(0);
+
+  std::vector<int> vec(counts);
+  for (auto& v : vec) {
+    v = ::rand()%10;
+  }
+
+  Threadpool threadpool(s.range(1));
+  size_t chunk_size = s.range(2);
+ 
+  // Timing loop
+  for (auto _ : s) {
+    int r = par_reduce_fork_join(vec, 100, chunk_size, threadpool);
+    benchmark::DoNotOptimize(r);
+  }
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_parallel_reduce_fork_join)
+  ->Args({10,1,64})
+  ->Args({100,1,64})
+  ->Args({1000,1,64})
+  ->Args({10000,1,64})
+  ->Args({100000,1,64})
+  ->Args({1000000,1,64})
+  ->Args({10000000,1,64})
+  ->Args({100000000,1,64})
+  ->Args({10,2,64})
+  ->Args({100,2,64})
+  ->Args({1000,2,64})
+  ->Args({10000,2,64})
+  ->Args({100000,2,64})
+  ->Args({1000000,2,64})
+  ->Args({10000000,2,64})
+  ->Args({100000000,2,64})
+  ->Args({10,4,64})
+  ->Args({100,4,64})
+  ->Args({1000,4,64})
+  ->Args({10000,4,64})
+  ->Args({100000,4,64})
+  ->Args({1000000,4,64})
+  ->Args({10000000,4,64})
+  ->Args({100000000,4,64})
+  ->Args({10,8,64})
+  ->Args({100,8,64})
+  ->Args({1000,8,64})
+  ->Args({10000,8,64})
+  ->Args({100000,8,64})
+  ->Args({1000000,8,64})
+  ->Args({10000000,8,64})
+  ->Args({100000000,8,64})
+  ->Args({10,1,1024})
+  ->Args({100,1,1024})
+  ->Args({1000,1,1024})
+  ->Args({10000,1,1024})
+  ->Args({100000,1,1024})
+  ->Args({1000000,1,1024})
+  ->Args({10000000,1,1024})
+  ->Args({100000000,1,1024})
+  ->Args({10,2,1024})
+  ->Args({100,2,1024})
+  ->Args({1000,2,1024})
+  ->Args({10000,2,1024})
+  ->Args({100000,2,1024})
+  ->Args({1000000,2,1024})
+  ->Args({10000000,2,1024})
+  ->Args({100000000,2,1024})
+  ->Args({10,4,1024})
+  ->Args({100,4,1024})
+  ->Args({1000,4,1024})
+  ->Args({10000,4,1024})
+  ->Args({100000,4,1024})
+  ->Args({1000000,4,1024})
+  ->Args({10000000,4,1024})
+  ->Args({100000000,4,1024})
+  ->Args({10,8,1024})
+  ->Args({100,8,1024})
+  ->Args({1000,8,1024})
+  ->Args({10000,8,1024})
+  ->Args({100000,8,1024})
+  ->Args({1000000,8,1024})
+  ->Args({10000000,8,1024})
+  ->Args({100000000,8,1024})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+// nested fork-join whose tasks help the pool (run_one, wait) while their
+// own children are still queued; the first argument is the depth of the
+// fork-join tree
+static void fork_join_helping(Threadpool& threadpool, size_t depth, std::atomic<size_t>& leaves) {
+  if (depth == 0) {
+    leaves.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  threadpool.parallel_invoke(
+    [&](){
+      fork_join_helping(threadpool, depth-1, leaves);
+      threadpool.run_one();
+    },
+    [&](){
+      TaskGroup group;
+      threadpool.insert(group, [&](){ leaves.fetch_add(1, std::memory_order_relaxed); });
+      fork_join_helping(threadpool, depth-1, leaves);
+      threadpool.wait(group);
+    }
+  );
+}
+
+static void benchmark_parallel_invoke_nested_help(benchmark::State& s) {
+  Threadpool threadpool(s.range(1));
+  std::atomic<size_t> leaves {0};
+
+  // Timing loop
+  for (auto _ : s) {
+    fork_join_helping(threadpool, s.range(0), leaves);
+  }
+  s.counters["leaves"] = benchmark::Counter(leaves.load(), benchmark::Counter::kAvgIterations);
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_parallel_invoke_nested_help)
+  ->Args({4,1})
+  ->Args({8,1})
+  ->Args({12,1})
+  ->Args({4,2})
+  ->Args({8,2})
+  ->Args({12,2})
+  ->Args({4,4})
+  ->Args({8,4})
+  ->Args({12,4})
+  ->Args({4,8})
+  ->Args({8,8})
+  ->Args({12,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMicrosecond);
+
+
+// submit/dequeue throughput of the threadpool on empty tasks
+// the third argument is the capacity of the lock-free ring (0 = locked queue)
+static void benchmark_threadpool_insert(benchmark::State& s) {
+  size_t tasks = s.range(0);
+
+  Threadpool threadpool(s.range(1), s.range(2));
+
+  std::vector<std::future<void>> futures;
+  futures.reserve(tasks);
+
+  // Timing loop
+  for (auto _ : s) {
+    for (size_t i = 0; i < tasks; ++i) {
+      futures.emplace_back(threadpool.insert([](){}));
+    }
+    for (auto& fu : futures) {
+      fu.get();
+    }
+    futures.clear();
+  }
+  s.SetItemsProcessed(s.iterations()*tasks);
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_threadpool_insert)
+  ->Args({100000,1,0})
+  ->Args({100000,2,0})
+  ->Args({100000,4,0})
+  ->Args({100000,8,0})
+  ->Args({100000,1,65536})
+  ->Args({100000,2,65536})
+  ->Args({100000,4,65536})
+  ->Args({100000,8,65536})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// submit/dequeue throughput of the threadpool on a batch of empty tasks
+// inserted at once
+static void benchmark_threadpool_insert_range(benchmark::State& s) {
+  size_t tasks = s.range(0);
+
+  Threadpool threadpool(s.range(1));
+
+  // Timing loop
+  for (auto _ : s) {
+    threadpool.insert_range(tasks, [](size_t){}).get();
+  }
+  s.SetItemsProcessed(s.iterations()*tasks);
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_threadpool_insert_range)
+  ->Args({100000,1})
+  ->Args({100000,2})
+  ->Args({100000,4})
+  ->Args({100000,8})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+// latency of a small reduction while the threadpool is saturated with
+// long-running 64x64 matrix multiplications; the fourth argument is the
+// priority of the reduction (0 = HIGH, 1 = NORMAL)
+static void benchmark_parallel_reduce_static_under_load(benchmark::State& s) {
+  size_t counts = s.range(0);
+
+  std::vector<int> vec(counts);
+  for (auto& v : vec) {
+    v = ::rand()%10;
+  }
+
+  size_t W = s.range(1);
+  size_t chunk_size = s.range(2);
+  Priority priority = static_cast<Priority>(s.range(3));
+
+  Threadpool threadpool(W);
+
+  const size_t n = 64;
+  std::vector<int> A(n*n, 2), B(n*n, 1);
+  std::vector<std::vector<int>> C(W*256, std::vector<int>(n*n, 0));
+
+  // Timing loop
+  for (auto _ : s) {
+    s.PauseTiming();
+    TaskGroup load;
+    for (auto& c : C) {
+      threadpool.insert(load, [&A, &B, &c, n](){
+        for (size_t i = 0; i < n; ++i) {
+          for (size_t k = 0; k < n; ++k) {
+            for (size_t j = 0; j < n; ++j) {
+              c[i*n + j] += A[i*n + k] * B[k*n + j];
+            }
+          }
+        }
+      });
+    }
+    s.ResumeTiming();
+
+    int r = threadpool.reduce_static(
+      vec.begin(), vec.end(), 100, [](int a, int b){ return a + b; }, chunk_size, priority
+    );
+    benchmark::DoNotOptimize(r);
+
+    s.PauseTiming();
+    threadpool.wait(load);
+    s.ResumeTiming();
+  }
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_parallel_reduce_static_under_load)
+  ->Args({1000,1,64,0})
+  ->Args({100000,1,64,0})
+  ->Args({1000,2,64,0})
+  ->Args({100000,2,64,0})
+  ->Args({1000,4,64,0})
+  ->Args({100000,4,64,0})
+  ->Args({1000,8,64,0})
+  ->Args({100000,8,64,0})
+  ->Args({1000,1,64,1})
+  ->Args({100000,1,64,1})
+  ->Args({1000,2,64,1})
+  ->Args({100000,2,64,1})
+  ->Args({1000,4,64,1})
+  ->Args({100000,4,64,1})
+  ->Args({1000,8,64,1})
+  ->Args({100000,8,64,1})
+  ->UseRealTime()
+  ->Unit(benchmark::kMicrosecond);
+
+
+// every queue layout and idle policy of BasicThreadpool
+using Pool_Centralized       = BasicThreadpool<CentralizedQueue>;
+using Pool_RoundRobin        = BasicThreadpool<RoundRobinQueues>;
+using Pool_WorkStealing      = BasicThreadpool<WorkStealingQueues>;
+using Pool_Centralized_Spin  = BasicThreadpool<CentralizedQueue, SpinIdle<4096, 64>>;
+using Pool_RoundRobin_Spin   = BasicThreadpool<RoundRobinQueues, SpinIdle<4096, 64>>;
+using Pool_WorkStealing_Spin = BasicThreadpool<WorkStealingQueues, SpinIdle<4096, 64>>;
+
+// parallel reduction with static scheduling on a BasicThreadpool
+template <typename Pool>
+static void benchmark_parallel_reduce_static_basic(benchmark::State& s) {
+  size_t counts = s.range(0);
+
+  std::vector<int> vec(counts);
+  for (auto& v : vec) {
+    v = ::rand()%10;
+  }
 
-BENCHMARK_MAIN();
+  Pool threadpool(s.range(1));
+  size_t chunk_size = s.range(2);
+ 
+  // Timing loop
+  for (auto _ : s) {
+    int r = par_reduce_static(vec, 100, chunk_size, threadpool);
+    benchmark::DoNotOptimize(r);
+  }
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_Centralized)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_RoundRobin)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_WorkStealing)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_Centralized_Spin)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_RoundRobin_Spin)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(benchmark_parallel_reduce_static_basic, Pool_WorkStealing_Spin)
+  ->Args({1000,1,64})
+  ->Args({1000,2,64})
+  ->Args({1000,4,64})
+  ->Args({1000,8,64})
+  ->Args({100000,1,64})
+  ->Args({100000,2,64})
+  ->Args({100000,4,64})
+  ->Args({100000,8,64})
+  ->Args({10000000,1,64})
+  ->Args({10000000,2,64})
+  ->Args({10000000,4,64})
+  ->Args({10000000,8,64})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+
+
+#ifdef THREADPOOL_COROUTINES
+
+// parallel reduction with coroutines
+// range(2) reductions in flight at once, awaited with a single when_all
+static void benchmark_parallel_reduce_async(benchmark::State& s) {
+  size_t counts = s.range(0);
+  size_t R = s.range(2);
+
+  std::vector<int> vec(counts);
+  for (auto& v : vec) {
+    v = ::rand()%10;
+  }
+
+  Threadpool threadpool(s.range(1));
+
+  // Timing loop
+  for (auto _ : s) {
+    std::vector<task<int>> requests;
+    for (size_t r = 0; r < R; ++r) {
+      requests.push_back(par_reduce_async(vec, 100, threadpool));
+    }
+    auto results = sync_wait(when_all(std::move(requests)));
+    benchmark::DoNotOptimize(results);
+  }
+
+  if (s.thread_index() == 0) {
+    threadpool.shutdown();
+  }
+}
+
+BENCHMARK(benchmark_parallel_reduce_async)
+  ->Args({1000,1,1})
+  ->Args({1000,1,64})
+  ->Args({1000,1,1024})
+  ->Args({1000,2,1})
+  ->Args({1000,2,64})
+  ->Args({1000,2,1024})
+  ->Args({1000,4,1})
+  ->Args({1000,4,64})
+  ->Args({1000,4,1024})
+  ->Args({1000,8,1})
+  ->Args({1000,8,64})
+  ->Args({1000,8,1024})
+  ->Args({100000,1,1})
+  ->Args({100000,1,64})
+  ->Args({100000,1,1024})
+  ->Args({100000,2,1})
+  ->Args({100000,2,64})
+  ->Args({100000,2,1024})
+  ->Args({100000,4,1})
+  ->Args({100000,4,64})
+  ->Args({100000,4,1024})
+  ->Args({100000,8,1})
+  ->Args({100000,8,64})
+  ->Args({100000,8,1024})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+#endif
+
+// same as BENCHMARK_MAIN(), plus --trace=<file> to record a Chrome trace
+// of every task the pools run (open it in Perfetto)
+int main(int argc, char** argv) {
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--trace=", 0) == 0) {
+      Tracer::start(arg.substr(8));
+    }
+    else if (arg == "--trace") {
+      Tracer::start();
+    }
+    else {
+      args.push_back(argv[i]);
+    }
+  }
+  int n = static_cast<int>(args.size());
+  benchmark::Initialize(&n, args.data());
+  if (benchmark::ReportUnrecognizedArguments(n, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  Tracer::stop();
+  return 0;
+}
 
 
 
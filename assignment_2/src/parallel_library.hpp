@@ -9,54 +9,288 @@
 #include <condition_variable>
 #include <type_traits>
 #include <numeric>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <array>
+#include "mpmc_queue.hpp"
+#include "task.hpp"
+#include "task_group.hpp"
+#include "idle_policy.hpp"
+#include "topology.hpp"
+#include "work_stealing_queue.hpp"
+#include "basic_threadpool.hpp"
+#include "pool_stats.hpp"
+#include "tracer.hpp"
+#include "coroutine.hpp"
 
-template <typename T>
-struct MoC {
+// ----------------------------------------------------------------------------
+// Class definition for a fork-join child job
+// A job lives in the frame of the task that spawned it, so spawning costs
+// no allocation; the spawner must not return before the job is done
+// ----------------------------------------------------------------------------
+
+struct Job {
 
-  MoC(T&& rhs) : object(std::move(rhs)) {}
-  MoC(const MoC& other) : object(std::move(other.object)) {}
+  explicit Job(void (*f)(Job*)) : invoke{f} {}
 
-  T& get() { return object; }
+  // called by the worker w that runs the job; the job must not be touched
+  // after it is done
+  void run(size_t w) {
+    thief.store(w, std::memory_order_release);
+    invoke(this);
+    done.store(true, std::memory_order_release);
+  }
 
-  mutable T object;
+  void (*invoke)(Job*);
+  std::atomic<size_t> thief {SIZE_MAX};
+  std::atomic<bool> done {false};
 };
 
+template <typename F>
+struct ChildJob : Job {
+
+  explicit ChildJob(F& f) : Job{[](Job* j){ static_cast<ChildJob*>(j)->fn(); }}, fn{f} {}
+
+  F& fn;
+};
+
+// reduce with static scheduling on any pool; extra hints (e.g. a
+// Priority) are passed through to the pool's insert and wait
+template <typename Pool, typename Input, typename T, typename F, typename... Hints>
+T reduce_static(Pool& pool, Input beg, Input end, T init, F bop, size_t chunk_size = 2,
+                Hints... hints) {
+
+  // the total number of elements in the range [beg, end)
+  size_t N = std::distance(beg, end);
+
+  TaskGroup group;
+
+  std::atomic<size_t> takens{0};
+
+  std::mutex mutex;
+
+  for (size_t i = 0; i < pool.num_workers(); ++i) {
+    pool.insert(group, labeled("reduce_static", [N, beg, end, bop, &init, &mutex, chunk_size, &takens](){
+      
+      // pre-reduce
+      size_t curr_b = takens.fetch_add(2, std::memory_order_relaxed);
+
+      // corner case #1: no more elements to reduce
+      if(curr_b >= N) {
+        return;
+      }
+
+      // corner case #2: only one element left
+      if(N - curr_b == 1) {
+        std::scoped_lock lock(mutex);
+        init = bop(init, *(beg + curr_b));
+        return;
+      }
+
+      // perform a reduction on these two elements
+      T temp = bop(*(beg+curr_b), *(beg+curr_b+1));
+      
+      curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
+      
+      while (curr_b < N) {
+        size_t curr_e = std::min(N, curr_b + chunk_size);
+        // run a sequential reduction to the range specified by beg + [curr_b, curr_e)
+        temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
+        
+        // get the next chunk
+        curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
+      }
+
+      // perform a final reduction on temp with init
+      {
+        std::scoped_lock lock(mutex);
+        init = bop(init, temp);
+      }
+    }), hints...);
+  }
+
+  // caller thread helps to run the W tasks until they finish
+  pool.wait(group, hints...);
+
+  return init;
+}
+
+// reduce with guided scheduling on any pool, see reduce_static
+template <typename Pool, typename Input, typename T, typename F, typename... Hints>
+T reduce_guided(Pool& pool, Input beg, Input end, T init, F bop, size_t chunk_size = 2,
+                Hints... hints) {
+
+  // the total number of elements in the range [beg, end)
+  size_t N = std::distance(beg, end);
+
+  TaskGroup group;
+
+  std::atomic<size_t> takens{0};
+
+  std::mutex mutex;
+
+  size_t workers = pool.num_workers();
+
+  for (size_t i = 0; i < pool.num_workers(); ++i) {
+    pool.insert(group, labeled("reduce_guided", [N, beg, end, bop, &init, &mutex, chunk_size, &takens, workers](){
+      
+      size_t threshold = 2*workers*(chunk_size+1);  // threshold to perform fine-grained scheduling
+      float  p = 1.0/(2*workers);
+
+      T temp{0};
+      size_t curr_b = takens.load(std::memory_order_relaxed);
+
+      while(curr_b < N) {
+        size_t remaining = N - curr_b;
+       
+        // fine grained 
+        if (remaining <= threshold) {
+          curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
+          if(curr_b >= N) {
+            break;
+          }
+          size_t curr_e = std::min(N, curr_b + chunk_size);
+          temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
+          curr_b = takens.load(std::memory_order_relaxed);
+        }
+
+        // coarse grained
+        else {
+          size_t q = remaining * p;
+          if (q < chunk_size) {
+            q = chunk_size;
+          }
+
+          size_t curr_e = std::min(N, curr_b + q);
+
+          if (takens.compare_exchange_strong(curr_b, curr_e, std::memory_order_relaxed,
+                                                             std::memory_order_relaxed)) {
+            
+            temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
+            curr_b = takens.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      // perform a final reduction on temp with init
+      {
+        std::scoped_lock lock(mutex);
+        init = bop(init, temp);
+      }
+    }), hints...);
+  }
+
+  // caller thread helps to run the W tasks until they finish
+  pool.wait(group, hints...);
+
+  return init;
+}
+
+
 // ----------------------------------------------------------------------------
 // Class definition for Threadpool
+// Every priority level has its own queue and workers serve the most
+// urgent one first; the lock-free ring only carries NORMAL tasks
 // ----------------------------------------------------------------------------
 
 class Threadpool {
 
   public:
+
+    // every starvation_limit-th task a worker picks is the oldest task of
+    // the least urgent waiting level, so LOW tasks still make progress
+    // under a steady stream of HIGH ones
+    static constexpr size_t starvation_limit = 64;
     
     // constructor tasks a unsigned integer representing the number of
-    // workers you need
-    Threadpool(size_t N) {
+    // workers you need, and optionally the capacity of a lock-free ring
+    // buffer used in front of the locked queue (0 disables the ring),
+    // how long an idle worker spins before it parks and how the workers
+    // are pinned to cpus
+    Threadpool(size_t N, size_t ring_capacity = 0, IdlePolicy idle_policy = {},
+               Placement placement = Placement::NONE) : idle{idle_policy}, locals(N), recorder(N) {
+
+      auto cpus = topology::place(placement, N);
+
+      if (ring_capacity > 0) {
+        ring = std::make_unique<MPMCQueue<Task>>(ring_capacity);
+      }
 
       for(size_t i=0; i<N; i++) {
-        threads.emplace_back([this](){
+        threads.emplace_back([this, i](){
+
+          worker_pool = this;
+          worker_id   = i;
+          Tracer::set_worker(i);
+
+          size_t picks = 0;
+
           // keep doing my job until the main thread sends a stop signal
           while(!stop) {
-            std::function<void()> task;
-            // my job is to iteratively grab a task from the queue
-            {
+            // fork-join children come first: mine, then the others'
+            auto since = recorder.now();
+            bool stolen = false;
+            if(run_job(i, &stolen)) {
+              if(stolen) {
+                recorder.steal(i);
+              }
+              recorder.task_done(i, since);
+              continue;
+            }
+            since = recorder.now();
+            Task task;
+            // urgent tasks skip the ring, and now and then the least
+            // urgent one goes first
+            if(++picks % starvation_limit == 0 && queued.load(std::memory_order_relaxed) > 0) {
+              std::scoped_lock lock(mtx);
+              pop(task, Priority::LOW, true);
+            }
+            else if(urgent.load(std::memory_order_relaxed) > 0) {
+              std::scoped_lock lock(mtx);
+              pop(task, Priority::HIGH);
+            }
+            // my job is to iteratively grab a task from the ring first
+            // and fall back to the locked queue when the ring is empty;
+            // with nothing in sight, spin for a while before parking
+            if(!task && (!ring || !ring->try_pop(task))) {
+              if(idle.spin_until([this](){ return has_work(); }) && stealable()) {
+                continue;
+              }
+            }
+            if(!task && (!ring || !ring->try_pop(task))) {
               // Best practice: anything that happens inside the while continuation check
               // should always be protected by lock
               std::unique_lock lock(mtx);
-              while(queue.empty() && !stop) {
+              while(queued.load(std::memory_order_relaxed) == 0 && !stop) {
+                // announce myself before the last look at the ring and the
+                // local queues so that a concurrent push either sees me or
+                // I see the pushed task
+                sleeping.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if((ring && !ring->empty()) || stealable()) {
+                  sleeping.fetch_sub(1);
+                  break;
+                }
                 cv.wait(lock);
+                sleeping.fetch_sub(1);
+                recorder.wakeup(i);
               }
-              if(!queue.empty()) {
-                task = queue.front();
-                queue.pop();
-              }
+              pop(task, Priority::LOW);
             }
+            recorder.idle_done(i, since);
             // and run the task...
             if(task) {
-              task();
+              recorder.queue_depth(i, [this](){ return queued.load(std::memory_order_relaxed) + 1; });
+              since = recorder.now();
+              run_traced(task);
+              recorder.task_done(i, since);
             }
           }
         });
+        if(!cpus.empty()) {
+          topology::pin(threads.back(), cpus[i].cpu);
+        }
       }
     }
 
@@ -77,163 +311,318 @@ class Threadpool {
 
     // insert a task "callable object" into the threadpool
     template <typename C>
-    auto insert(C&& task) {
+    auto insert(C&& task, Priority priority = Priority::NORMAL) {
       std::promise<void> promise;
       auto fu = promise.get_future();
-      {
-        std::scoped_lock lock(mtx);
-        queue.push(
-          [moc=MoC{std::move(promise)}, task=std::forward<C>(task)] () mutable {
-            task();
-            moc.object.set_value();
-          }
-        );
-      }
-      cv.notify_one();
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        },
+        priority
+      );
       return fu;
     }
 
-    // reduce with static scheduling
-    template <typename Input, typename T, typename F>
-    T reduce_static(Input beg, Input end, T init, F bop, size_t chunk_size = 2) {
-    
-      // the total number of elements in the range [beg, end)
-      size_t N = std::distance(beg, end);
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task, Priority priority = Priority::NORMAL) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      }, priority);
+    }
 
-      std::vector<std::future<void>> futures;
-    
-      std::atomic<size_t> takens{0};
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker, queued
+    // at the given priority
+    auto schedule(Priority priority = Priority::NORMAL) {
+      return ScheduleAwaiter<Threadpool, Priority>(*this, priority);
+    }
+#endif
 
-      std::mutex mutex;
+    // insert a task without creating a future for it
+    template <typename C>
+    void silent_insert(C&& task, Priority priority = Priority::NORMAL) {
+      Task t(std::forward<C>(task));
+      // lock-free fast path, only wake up a worker if someone is parked
+      if(priority == Priority::NORMAL && ring && ring->try_push(std::move(t))) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleeping.load() > 0) {
+          std::scoped_lock lock(mtx);
+          cv.notify_one();
+        }
+        return;
+      }
+      // the ring is full or disabled
+      bool wake;
+      {
+        std::scoped_lock lock(mtx);
+        queues[static_cast<size_t>(priority)].push(std::move(t));
+        count();
+        wake = sleeping.load() > 0;
+      }
+      if(wake) {
+        cv.notify_one();
+      }
+    }
 
-      for (size_t i = 0; i < threads.size(); ++i) {
-        futures.emplace_back(insert([N, beg, end, bop, &init, &mutex, chunk_size, &takens](){
-          
-          // pre-reduce
-          size_t curr_b = takens.fetch_add(2, std::memory_order_relaxed);
+    // insert n tasks fn(0), ..., fn(n-1) under a single lock and wake up
+    // as many workers as there are tasks; the returned future becomes
+    // ready once all of them have finished
+    template <typename F>
+    std::future<void> insert_range(size_t n, F&& fn, Priority priority = Priority::NORMAL) {
+      auto state = new RangeState<std::decay_t<F>>(n, std::forward<F>(fn));
+      auto fu = state->promise.get_future();
+      push_range(state, n, priority);
+      return fu;
+    }
 
-          // corner case #1: no more elements to reduce
-          if(curr_b >= N) {
-            return;
-          }
+    // insert n tasks fn(0), ..., fn(n-1) as one member of a task group
+    template <typename F>
+    void insert_range(TaskGroup& group, size_t n, F&& fn, Priority priority = Priority::NORMAL) {
+      push_range(new RangeState<std::decay_t<F>>(n, std::forward<F>(fn), &group), n, priority);
+    }
 
-          // corner case #2: only one element left
-          if(N - curr_b == 1) {
-            std::scoped_lock lock(mutex);
-            init = bop(init, *(beg + curr_b));
-            return;
-          }
+    // run one queued task on the calling thread, returns false if there
+    // was nothing to run; tasks less urgent than the given priority are
+    // left to the workers
+    bool run_one(Priority priority = Priority::LOW) {
+      if(run_job(worker_pool == this ? worker_id : locals.size())) {
+        return true;
+      }
+      Task task;
+      if(urgent.load(std::memory_order_relaxed) > 0 || priority == Priority::HIGH ||
+         !ring || !ring->try_pop(task)) {
+        std::scoped_lock lock(mtx);
+        pop(task, priority);
+      }
+      if(!task) {
+        return false;
+      }
+      run_traced(task);
+      return true;
+    }
 
-          // perform a reduction on these two elements
-          T temp = bop(*(beg+curr_b), *(beg+curr_b+1));
-          
-          curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
-          
-          while (curr_b < N) {
-            size_t curr_e = std::min(N, curr_b + chunk_size);
-            // run a sequential reduction to the range specified by beg + [curr_b, curr_e)
-            temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
-            
-            // get the next chunk
-            curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
-          }
+    // wait for a task group while helping the workers: the caller runs
+    // queued tasks until the queue drains and only then blocks, so a task
+    // may itself insert into this pool and wait without deadlocking it;
+    // the caller only helps with tasks at least as urgent as the given
+    // priority, so an urgent wait does not get stuck behind a long task
+    void wait(TaskGroup& group, Priority priority = Priority::LOW) {
+      while(group.size() > 0 && run_one(priority)) {
+      }
+      group.wait();
+    }
 
-          // perform a final reduction on temp with init
-          {
-            std::scoped_lock lock(mutex);
-            init = bop(init, temp);
-          }
-        }));
+    // run f and g in parallel (fork-join): g is pushed to the local queue
+    // of the calling worker, where idle workers can steal it, while f runs
+    // inline; if nobody stole g by the time f returns, g runs inline too,
+    // otherwise the worker helps with other children until g is done
+    template <typename F, typename G>
+    void parallel_invoke(F&& f, G&& g) {
+
+      // not a worker of this pool: there is no local queue to push to, so
+      // hand the whole fork-join to a worker and block until it is done
+      if(worker_pool != this) {
+        TaskGroup group;
+        insert(group, [this, &f, &g](){ parallel_invoke(f, g); });
+        group.wait();
+        return;
       }
 
-      // caller thread to wait for all W tasks finish (futures)
-      for(auto & fu : futures) {
-        fu.get();
+      size_t id = worker_id;
+      ChildJob<std::remove_reference_t<G>> child(g);
+      locals[id].push(&child);
+      wake_one();
+
+      f();
+
+      // every child spawned by f has been synchronized, so the bottom of
+      // my queue is my child, unless it was stolen or f helped (run_one,
+      // wait) and ran it itself; then whatever is at the bottom belongs to
+      // an enclosing parallel_invoke and goes back
+      Job* bottom = locals[id].pop();
+      if(bottom == &child) {
+        g();
+        return;
+      }
+      if(bottom) {
+        locals[id].push(bottom);
       }
 
-      return init;
+      // g was stolen: help the thief with its own children (leapfrogging),
+      // which are descendants of g, so the stack depth stays bounded
+      while(!child.done.load(std::memory_order_acquire)) {
+        size_t thief = child.thief.load(std::memory_order_acquire);
+        Job* job {nullptr};
+        if(thief < locals.size()) {
+          job = locals[thief].steal();
+        }
+        if(job) {
+          run_traced([job, id](){ job->run(id); });
+        }
+        else {
+          std::this_thread::yield();
+        }
+      }
     }
-    
-    // reduce with guided scheduling
+
+    // reduce with recursive fork-join splitting down to chunk_size elements
     template <typename Input, typename T, typename F>
-    T reduce_guided(Input beg, Input end, T init, F bop, size_t chunk_size = 2) {
-    
+    T reduce_fork_join(Input beg, Input end, T init, F bop, size_t chunk_size = 1024) {
+
       // the total number of elements in the range [beg, end)
       size_t N = std::distance(beg, end);
 
-      std::vector<std::future<void>> futures;
-    
-      std::atomic<size_t> takens{0};
+      if(N <= chunk_size || N < 2) {
+        return std::accumulate(beg, end, init, bop);
+      }
 
-      std::mutex mutex;
+      // the right half starts from its first element, so no identity is needed
+      Input mid = beg + N/2;
+      T left, right;
+      parallel_invoke(
+        [&](){ left  = reduce_fork_join(beg, mid, init, bop, chunk_size); },
+        [&](){ right = reduce_fork_join(mid + 1, end, *mid, bop, chunk_size); }
+      );
+      return bop(left, right);
+    }
 
-      size_t workers = threads.size();
+    // reduce with static scheduling
+    template <typename Input, typename T, typename F>
+    T reduce_static(Input beg, Input end, T init, F bop, size_t chunk_size = 2,
+                    Priority priority = Priority::NORMAL) {
+      return ::reduce_static(*this, beg, end, init, bop, chunk_size, priority);
+    }
 
-      for (size_t i = 0; i < threads.size(); ++i) {
-        futures.emplace_back(insert([N, beg, end, bop, &init, &mutex, chunk_size, &takens, workers](){
-          
-          size_t threshold = 2*workers*(chunk_size+1);  // threshold to perform fine-grained scheduling
-          float  p = 1.0/(2*workers);
+    // reduce with guided scheduling
+    template <typename Input, typename T, typename F>
+    T reduce_guided(Input beg, Input end, T init, F bop, size_t chunk_size = 2,
+                    Priority priority = Priority::NORMAL) {
+      return ::reduce_guided(*this, beg, end, init, bop, chunk_size, priority);
+    }
 
-          T temp{0};
-          size_t curr_b = takens.load(std::memory_order_relaxed);
+    size_t num_workers() const {
+      return threads.size();
+    }
 
-          while(curr_b < N) {
-            size_t remaining = N - curr_b;
-           
-            // fine grained 
-            if (remaining <= threshold) {
-              curr_b = takens.fetch_add(chunk_size, std::memory_order_relaxed);
-              if(curr_b >= N) {
-                break;
-              }
-              size_t curr_e = std::min(N, curr_b + chunk_size);
-              temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
-              curr_b = takens.load(std::memory_order_relaxed);
-            }
+    // snapshot of the per-worker counters (empty unless THREADPOOL_STATS)
+    PoolStats stats() const {
+      return recorder.snapshot();
+    }
 
-            // coarse grained
-            else {
-              size_t q = remaining * p;
-              if (q < chunk_size) {
-                q = chunk_size;
-              }
 
-              size_t curr_e = std::min(N, curr_b + q);
+  private:
 
-              if (takens.compare_exchange_strong(curr_b, curr_e, std::memory_order_relaxed,
-                                                                 std::memory_order_relaxed)) {
-                
-                temp = std::accumulate(beg + curr_b, beg + curr_e, temp, bop);
-                curr_b = takens.load(std::memory_order_relaxed);
-              }
-            }
-          }
+    // pop the oldest task of the most urgent non-empty level that is at
+    // least as urgent as the given one (or of the least urgent level if
+    // least_urgent_first is set); the caller holds the lock
+    void pop(Task& task, Priority priority, bool least_urgent_first = false) {
+      size_t last = static_cast<size_t>(priority);
+      for (size_t l = 0; l <= last; ++l) {
+        auto& q = queues[least_urgent_first ? last - l : l];
+        if(!q.empty()) {
+          task = std::move(q.front());
+          q.pop();
+          count();
+          return;
+        }
+      }
+    }
 
-          // perform a final reduction on temp with init
-          {
-            std::scoped_lock lock(mutex);
-            init = bop(init, temp);
-          }
-        }));
+    // refresh the lock-free counters; the caller holds the lock
+    void count() {
+      size_t n = 0;
+      for (auto& q : queues) {
+        n += q.size();
       }
+      queued.store(n, std::memory_order_relaxed);
+      urgent.store(queues[static_cast<size_t>(Priority::HIGH)].size(), std::memory_order_relaxed);
+    }
+
+    // whether a spinning worker should go for the queues
+    bool has_work() const {
+      return stop || queued.load(std::memory_order_relaxed) > 0 ||
+             (ring && !ring->empty()) || stealable();
+    }
 
-      // caller thread to wait for all W tasks finish (futures)
-      for(auto & fu : futures) {
-        fu.get();
+    // run one fork-join child: pop from my own local queue (if i is a
+    // worker) or steal from the others, returns false if there was none
+    bool run_job(size_t i, bool* stolen = nullptr) {
+      Job* job {nullptr};
+      if(i < locals.size()) {
+        job = locals[i].pop();
       }
+      for (size_t v = 1; v <= locals.size() && !job; ++v) {
+        if((job = locals[(i+v)%locals.size()].steal()) && stolen) {
+          *stolen = true;
+        }
+      }
+      if(!job) {
+        return false;
+      }
+      run_traced([job, i](){ job->run(i); });
+      return true;
+    }
 
-      return init;
+    bool stealable() const {
+      for(auto& q : locals) {
+        if(!q.empty()) {
+          return true;
+        }
+      }
+      return false;
     }
 
+    // wake up one parked worker, if any
+    void wake_one() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(sleeping.load() > 0) {
+        std::scoped_lock lock(mtx);
+        cv.notify_one();
+      }
+    }
 
-  private:
+    template <typename S>
+    void push_range(S* state, size_t n, Priority priority) {
+      if(n == 0) {
+        state->finish();
+        return;
+      }
+      // wake up as many parked workers as there are tasks
+      size_t wake;
+      {
+        std::scoped_lock lock(mtx);
+        auto& q = queues[static_cast<size_t>(priority)];
+        for (size_t i = 0; i < n; ++i) {
+          q.emplace([state, i](){ state->run(i); });
+        }
+        count();
+        wake = std::min(n, sleeping.load());
+      }
+      for (size_t w = 0; w < wake; ++w) {
+        cv.notify_one();
+      }
+    }
 
     std::mutex mtx;
     std::vector<std::thread> threads;
     std::condition_variable cv;
-    bool stop {false};
-    std::queue< std::function<void()> > queue;
+    
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> sleeping {0};
+    std::atomic<size_t> queued {0};       // tasks in all locked queues
+    std::atomic<size_t> urgent {0};       // tasks in the HIGH queue
+    std::array<std::queue<Task>, num_priorities> queues;
+    std::unique_ptr<MPMCQueue<Task>> ring;
+    IdlePolicy idle;
+    std::vector<WorkStealingQueue<Job*>> locals;
+    StatsRecorder<> recorder;
+
+    inline static thread_local Threadpool* worker_pool {nullptr};
+    inline static thread_local size_t worker_id {0};
 
 };
 
@@ -249,9 +638,11 @@ auto seq_reduce(std::vector<int>& vec, int initial) {
   );
 }
 
-auto par_reduce_static(std::vector<int>& vec, int initial, size_t chunk_size, Threadpool& threadpool) {
+template <typename Pool>
+auto par_reduce_static(std::vector<int>& vec, int initial, size_t chunk_size, Pool& threadpool) {
   return 
-  threadpool.reduce_static(
+  reduce_static(
+    threadpool,
     vec.begin(), 
     vec.end(), 
     initial, 
@@ -263,9 +654,11 @@ auto par_reduce_static(std::vector<int>& vec, int initial, size_t chunk_size, Th
 
 }
 
-auto par_reduce_guided(std::vector<int>& vec, int initial, size_t chunk_size, Threadpool& threadpool) {
+template <typename Pool>
+auto par_reduce_guided(std::vector<int>& vec, int initial, size_t chunk_size, Pool& threadpool) {
   return
-  threadpool.reduce_guided(
+  reduce_guided(
+    threadpool,
     vec.begin(), 
     vec.end(), 
     initial, 
@@ -275,3 +668,64 @@ auto par_reduce_guided(std::vector<int>& vec, int initial, size_t chunk_size, Th
     chunk_size
   );
 }
+
+auto par_reduce_fork_join(std::vector<int>& vec, int initial, size_t chunk_size, Threadpool& threadpool) {
+  return
+  threadpool.reduce_fork_join(
+    vec.begin(), 
+    vec.end(), 
+    initial, 
+    [](int a, int b){
+      return a + b;
+    },
+    chunk_size
+  );
+}
+
+#ifdef THREADPOOL_COROUTINES
+
+// reduce one part of a range on a worker of the pool; the part starts
+// from its first element, so no identity is needed
+template <typename T, typename Pool, typename Input, typename F, typename... Hints>
+task<T> reduce_part_async(Pool& pool, Input beg, Input end, F bop, Hints... hints) {
+  co_await pool.schedule(hints...);
+  co_return std::accumulate(beg + 1, end, T(*beg), bop);
+}
+
+// coroutine variant of reduce_static: the range is cut into one part per
+// worker and the awaiting coroutine is resumed by the part that finishes
+// last, so no thread blocks while the reduction is in flight; extra hints
+// (e.g. a Priority) are passed through to the pool's schedule
+template <typename Pool, typename Input, typename T, typename F, typename... Hints>
+task<T> reduce_async(Pool& pool, Input beg, Input end, T init, F bop, Hints... hints) {
+
+  // the total number of elements in the range [beg, end)
+  size_t N = std::distance(beg, end);
+  size_t P = std::min(N, pool.num_workers());
+
+  std::vector<task<T>> parts;
+  for (size_t p = 0; p < P; ++p) {
+    parts.push_back(reduce_part_async<T>(pool, beg + N*p/P, beg + N*(p+1)/P, bop, hints...));
+  }
+
+  for (T& part : co_await when_all(std::move(parts))) {
+    init = bop(init, part);
+  }
+  co_return init;
+}
+
+template <typename Pool>
+task<int> par_reduce_async(std::vector<int>& vec, int initial, Pool& threadpool) {
+  return
+  reduce_async(
+    threadpool,
+    vec.begin(),
+    vec.end(),
+    initial,
+    [](int a, int b){
+      return a + b;
+    }
+  );
+}
+
+#endif
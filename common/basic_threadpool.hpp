@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "task.hpp"
+#include "task_group.hpp"
+#include "idle_policy.hpp"
+#include "queue_policies.hpp"
+#include "topology.hpp"
+#include "pool_stats.hpp"
+#include "tracer.hpp"
+#include "coroutine.hpp"
+
+// ----------------------------------------------------------------------------
+// Class definition for BasicThreadpool
+// One worker loop for every queue layout: the queue policy (see
+// queue_policies.hpp) decides where a task goes and where a worker looks
+// for one, the idle policy how long a worker spins before it parks, and
+// TaskType how a task is stored. All three are template parameters, so the
+// hot path has no virtual dispatch, e.g.
+//   BasicThreadpool<CentralizedQueue>                    like Threadpool_C
+//   BasicThreadpool<RoundRobinQueues>                    like Threadpool_D
+//   BasicThreadpool<WorkStealingQueues, SpinIdle<1024>>  like Threadpool_W,
+//                                                        spinning when idle
+// ----------------------------------------------------------------------------
+
+template <
+  template <typename> class QueuePolicy,
+  typename Idle = BlockIdle,
+  typename TaskType = Task
+>
+class BasicThreadpool {
+
+  public:
+
+    // constructor tasks a unsigned integer representing the number of
+    // workers you need, and optionally the idle policy object (for a
+    // runtime IdlePolicy) and how the workers are pinned to cpus
+    BasicThreadpool(size_t N, Idle idle_policy = {}, Placement placement = Placement::NONE) :
+      number_threads{N}, queues(N), cvs(N), parked(N, 0), idle{idle_policy}, recorder(N) {
+
+      auto cpus = topology::place(placement, N);
+
+      for (size_t i = 0; i < N; i++) {
+        threads.emplace_back([this, i](){
+
+          worker_pool = this;
+          worker_id   = i;
+          Tracer::set_worker(i);
+
+          // keep doing my job until the main thread sends a stop signal
+          while(!stop.load(std::memory_order_relaxed)) {
+            TaskType task;
+            bool stolen = false;
+            if(queues.pop(i, task, &stolen)) {
+              recorder.queue_depth(i, [this, i](){ return queues.depth(i) + 1; });
+              if(stolen) {
+                recorder.steal(i);
+              }
+              auto since = recorder.now();
+              run_traced(task);
+              recorder.task_done(i, since);
+              continue;
+            }
+            // with nothing in sight, spin for a while before parking
+            auto since = recorder.now();
+            if(!idle.spin_until([this, i](){
+              return stop.load(std::memory_order_relaxed) || queues.has_work(i);
+            })) {
+              park(i);
+            }
+            recorder.idle_done(i, since);
+          }
+        });
+        if(!cpus.empty()) {
+          topology::pin(threads.back(), cpus[i].cpu);
+        }
+      }
+    }
+
+    // destructor will release all threading resources by joining all of them
+    ~BasicThreadpool() {
+      for(auto& t : threads) {
+        t.join();
+      }
+    }
+
+    // shutdown the threadpool
+    void shutdown() {
+      std::scoped_lock lock(mtx);
+      stop = true;
+      for(auto& cv : cvs) {
+        cv.notify_all();
+      }
+    }
+
+    // insert a task "callable object" into the threadpool
+    template <typename C>
+    auto insert(C&& task) {
+      std::promise<void> promise;
+      auto fu = promise.get_future();
+      silent_insert(
+        [promise=std::move(promise), task=std::forward<C>(task)] () mutable {
+          task();
+          promise.set_value();
+        }
+      );
+      return fu;
+    }
+
+    // insert a task into the threadpool and attach it to a task group
+    template <typename C>
+    void insert(TaskGroup& group, C&& task) {
+      group.add();
+      silent_insert([&group, task=std::forward<C>(task)] () mutable {
+        task();
+        group.done();
+      });
+    }
+
+#ifdef THREADPOOL_COROUTINES
+    // co_await pool.schedule() resumes the coroutine on a worker
+    auto schedule() {
+      return ScheduleAwaiter<BasicThreadpool>(*this);
+    }
+#endif
+
+    // insert a task without creating a future for it
+    template <typename C>
+    void silent_insert(C&& task) {
+      wake(queues.push(self(), TaskType(std::forward<C>(task))));
+    }
+
+    // insert n tasks fn(0), ..., fn(n-1); the returned future becomes
+    // ready once all of them have finished
+    template <typename F>
+    std::future<void> insert_range(size_t n, F&& fn) {
+      auto state = new RangeState<std::decay_t<F>>(n, std::forward<F>(fn));
+      auto fu = state->promise.get_future();
+      push_range(state, n);
+      return fu;
+    }
+
+    // insert n tasks fn(0), ..., fn(n-1) as one member of a task group
+    template <typename F>
+    void insert_range(TaskGroup& group, size_t n, F&& fn) {
+      push_range(new RangeState<std::decay_t<F>>(n, std::forward<F>(fn), &group), n);
+    }
+
+    // run one queued task on the calling thread, returns false if there
+    // was nothing to run
+    bool run_one() {
+      TaskType task;
+      if(!queues.pop(self(), task)) {
+        return false;
+      }
+      run_traced(task);
+      return true;
+    }
+
+    // wait for a task group while helping the workers
+    void wait(TaskGroup& group) {
+      while(group.size() > 0 && run_one()) {
+      }
+      group.wait();
+    }
+
+    size_t num_workers() const {
+      return number_threads;
+    }
+
+    // snapshot of the per-worker counters (empty unless THREADPOOL_STATS)
+    PoolStats stats() const {
+      return recorder.snapshot();
+    }
+
+  private:
+
+    // the worker id of the calling thread, or number_threads if it is not
+    // a worker of this pool
+    size_t self() const {
+      return worker_pool == this ? worker_id : number_threads;
+    }
+
+    void park(size_t i) {
+      std::unique_lock lock(mtx);
+      // announce myself before the last look at the queues so that a
+      // concurrent push either sees me or I see the pushed task
+      parked[i] = 1;
+      sleeping.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(!stop && !queues.has_work(i)) {
+        cvs[i].wait(lock);
+        recorder.wakeup(i);
+      }
+      // a waker may have claimed me already
+      if(parked[i]) {
+        parked[i] = 0;
+        sleeping.fetch_sub(1);
+      }
+    }
+
+    // wake up worker w, or any parked worker if w is number_threads; the
+    // woken worker is claimed right away so that the next push wakes up
+    // another one
+    void wake(size_t w) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(sleeping.load() == 0) {
+        return;
+      }
+      std::scoped_lock lock(mtx);
+      if(w == number_threads) {
+        for (w = 0; w < number_threads && !parked[w]; ++w) {
+        }
+      }
+      if(w < number_threads && parked[w]) {
+        parked[w] = 0;
+        sleeping.fetch_sub(1);
+        cvs[w].notify_one();
+      }
+    }
+
+    template <typename S>
+    void push_range(S* state, size_t n) {
+      if(n == 0) {
+        state->finish();
+        return;
+      }
+      size_t s = self();
+      for (size_t i = 0; i < n; ++i) {
+        wake(queues.push(s, TaskType([state, i](){ state->run(i); })));
+      }
+    }
+
+    size_t number_threads;
+    QueuePolicy<TaskType> queues;
+    std::mutex mtx;
+    std::vector<std::thread> threads;
+    std::vector<std::condition_variable> cvs;
+    std::vector<char> parked;                // guarded by mtx
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> sleeping {0};
+    Idle idle;
+    StatsRecorder<> recorder;
+
+    inline static thread_local BasicThreadpool* worker_pool {nullptr};
+    inline static thread_local size_t worker_id {0};
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+// the coroutine support needs C++20 (cmake -DENABLE_COROUTINES=ON); in a
+// C++17 build this header is empty and THREADPOOL_COROUTINES stays undefined
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define THREADPOOL_COROUTINES 1
+
+#include <atomic>
+#include <coroutine>
+#include <cstdlib>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "task_group.hpp"
+
+template <typename T = void>
+class task;
+
+// ----------------------------------------------------------------------------
+// Promise types of task<T>
+// A task starts suspended and runs when it is awaited; when it finishes it
+// resumes its awaiter right away (symmetric transfer), so a chain of
+// awaiting tasks needs no queue round trips and no stack growth.
+// ----------------------------------------------------------------------------
+
+class TaskPromiseBase {
+
+  struct FinalAwaiter {
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      return h.promise().continuation;
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  public:
+
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+      return {};
+    }
+
+    // like the pools, tasks do not carry exceptions
+    void unhandled_exception() const noexcept {
+      std::abort();
+    }
+
+    std::coroutine_handle<> continuation {std::noop_coroutine()};
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+
+  public:
+
+    task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U&& v) {
+      value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+      return std::move(*value);
+    }
+
+  private:
+
+    std::optional<T> value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+
+  public:
+
+    task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {}
+
+    void result() const noexcept {}
+};
+
+// ----------------------------------------------------------------------------
+// Class definition for task
+// A lazily started coroutine returning a T. co_await it from another
+// coroutine, or block on it from plain code with sync_wait; a task moves
+// to a pool with co_await pool.schedule(), e.g.
+//   task<int> answer(Threadpool& pool) {
+//     co_await pool.schedule();   // from here on, on a worker
+//     co_return 42;
+//   }
+//   int x = sync_wait(answer(pool));
+// ----------------------------------------------------------------------------
+
+template <typename T>
+class task {
+
+  public:
+
+    using promise_type = TaskPromise<T>;
+    using handle_type  = std::coroutine_handle<promise_type>;
+
+    task() = default;
+
+    explicit task(handle_type h) : handle{h} {}
+
+    task(task&& rhs) noexcept : handle{std::exchange(rhs.handle, {})} {}
+
+    task& operator = (task&& rhs) noexcept {
+      if(this != &rhs) {
+        if(handle) {
+          handle.destroy();
+        }
+        handle = std::exchange(rhs.handle, {});
+      }
+      return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator = (const task&) = delete;
+
+    ~task() {
+      if(handle) {
+        handle.destroy();
+      }
+    }
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    // start the task; it resumes the awaiter once it finishes
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+      handle.promise().continuation = awaiter;
+      return handle;
+    }
+
+    T await_resume() {
+      return handle.promise().result();
+    }
+
+  private:
+
+    handle_type handle;
+};
+
+template <typename T>
+task<T> TaskPromise<T>::get_return_object() noexcept {
+  return task<T>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+
+inline task<void> TaskPromise<void>::get_return_object() noexcept {
+  return task<void>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+
+// ----------------------------------------------------------------------------
+// Class definition for ScheduleAwaiter
+// The awaitable returned by pool.schedule(): suspending on it queues the
+// coroutine on the pool, so it is resumed by whichever worker takes it.
+// Extra hints (e.g. a Priority) are passed through to silent_insert.
+// ----------------------------------------------------------------------------
+
+template <typename Pool, typename... Hints>
+class ScheduleAwaiter {
+
+  public:
+
+    explicit ScheduleAwaiter(Pool& p, Hints... h) : pool{p}, hints{h...} {}
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      std::apply([this, h](auto... hs){
+        pool.silent_insert([h](){ h.resume(); }, hs...);
+      }, hints);
+    }
+
+    void await_resume() const noexcept {}
+
+  private:
+
+    Pool& pool;
+    std::tuple<Hints...> hints;
+};
+
+// a coroutine that starts right away and frees itself when it finishes;
+// used to hook tasks up to plain code
+struct DetachedCoroutine {
+
+  struct promise_type {
+
+    DetachedCoroutine get_return_object() const noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() const noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() const noexcept {
+      return {};
+    }
+
+    void return_void() const noexcept {}
+
+    void unhandled_exception() const noexcept {
+      std::abort();
+    }
+  };
+};
+
+// block the calling thread until the task has finished and return its
+// result; the calling thread does not help the pool meanwhile
+template <typename T>
+T sync_wait(task<T> t) {
+
+  TaskGroup group;
+  group.add();
+
+  if constexpr (std::is_void_v<T>) {
+    [](task<T>& t, TaskGroup& group) -> DetachedCoroutine {
+      co_await t;
+      group.done();
+    }(t, group);
+    group.wait();
+  }
+  else {
+    std::optional<T> result;
+    [](task<T>& t, TaskGroup& group, std::optional<T>& result) -> DetachedCoroutine {
+      result.emplace(co_await t);
+      group.done();
+    }(t, group, result);
+    group.wait();
+    return std::move(*result);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// when_all
+// Await a batch of tasks at once: all of them are started right away and
+// the awaiter is resumed by the one that finishes last. The tasks only run
+// in parallel if they move to a pool (co_await pool.schedule()) first.
+// ----------------------------------------------------------------------------
+
+class WhenAllLatch {
+
+  public:
+
+    explicit WhenAllLatch(size_t n) : count{n} {}
+
+    // the last arrival resumes the awaiter
+    void arrive() {
+      if(count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        awaiter.resume();
+      }
+    }
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    // the awaiter holds one count itself until all tasks are started, so
+    // no task can resume it too early; if the tasks finished meanwhile it
+    // does not suspend at all
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+      awaiter = h;
+      return count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    void await_resume() const noexcept {}
+
+  private:
+
+    std::atomic<size_t> count;
+    std::coroutine_handle<> awaiter;
+};
+
+template <typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks) {
+
+  std::vector<std::optional<T>> results(tasks.size());
+  WhenAllLatch latch(tasks.size() + 1);
+
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    [](task<T>& t, std::optional<T>& result, WhenAllLatch& latch) -> DetachedCoroutine {
+      result.emplace(co_await t);
+      latch.arrive();
+    }(tasks[i], results[i], latch);
+  }
+  co_await latch;
+
+  std::vector<T> values;
+  values.reserve(results.size());
+  for (auto& r : results) {
+    values.push_back(std::move(*r));
+  }
+  co_return values;
+}
+
+inline task<void> when_all(std::vector<task<void>> tasks) {
+
+  WhenAllLatch latch(tasks.size() + 1);
+
+  for (auto& t : tasks) {
+    [](task<void>& t, WhenAllLatch& latch) -> DetachedCoroutine {
+      co_await t;
+      latch.arrive();
+    }(t, latch);
+  }
+  co_await latch;
+}
+
+#endif
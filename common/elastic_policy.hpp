@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+// ----------------------------------------------------------------------------
+// Elastic policy of a pool whose number of workers follows the load
+// The pool starts with min_workers, adds a worker whenever the queue gets
+// too deep for the live workers or a task waited too long, and retires a
+// worker that stayed idle for idle_timeout, never going below min_workers
+// ----------------------------------------------------------------------------
+
+struct ElasticPolicy {
+
+  size_t min_workers {1};
+  size_t max_workers {0};                         // 0 = hardware concurrency
+  size_t queue_depth {4};                         // waiting tasks per live worker
+  std::chrono::microseconds max_wait {0};         // 0 = ignore the waiting time
+  std::chrono::milliseconds idle_timeout {100};
+
+  // the upper bound with 0 resolved
+  size_t limit() const {
+    size_t n = max_workers ? max_workers : std::thread::hardware_concurrency();
+    return std::max<size_t>({n, min_workers, 1});
+  }
+};
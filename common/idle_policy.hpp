@@ -0,0 +1,64 @@
+#pragma once
+
+#include <thread>
+#include <utility>
+
+// ----------------------------------------------------------------------------
+// Idle policy of a worker that has run out of tasks
+// The worker first spins with a pause instruction, then yields its time
+// slice, and only then parks on the condition variable; a worker that is
+// not parked costs the inserting thread no wakeup system call
+// The default policy parks right away
+// ----------------------------------------------------------------------------
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+struct IdlePolicy {
+
+  size_t spins {0};    // rounds of pause before yielding
+  size_t yields {0};   // rounds of yield before parking
+
+  // spin, then yield, until ready() returns true or the budget runs out,
+  // returns whether ready() became true
+  template <typename P>
+  bool spin_until(P&& ready) const {
+    for (size_t i = 0; i < spins; ++i) {
+      if (ready()) {
+        return true;
+      }
+      cpu_relax();
+    }
+    for (size_t i = 0; i < yields; ++i) {
+      if (ready()) {
+        return true;
+      }
+      std::this_thread::yield();
+    }
+    return false;
+  }
+};
+
+// compile-time idle policies for BasicThreadpool: park right away, or spin
+// for a fixed budget before parking
+struct BlockIdle {
+
+  template <typename P>
+  static constexpr bool spin_until(P&&) {
+    return false;
+  }
+};
+
+template <size_t Spins, size_t Yields = 0>
+struct SpinIdle {
+
+  template <typename P>
+  static bool spin_until(P&& ready) {
+    return IdlePolicy{Spins, Yields}.spin_until(std::forward<P>(ready));
+  }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+// Class definition for a bounded lock-free MPMC queue
+// Every cell carries a sequence number that tells producers whether the
+// cell is free to write and consumers whether it is ready to read
+// (Dmitry Vyukov's bounded ring buffer)
+// The capacity is rounded up to a power of two
+// ----------------------------------------------------------------------------
+
+template <typename T>
+class MPMCQueue {
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  public:
+
+    explicit MPMCQueue(size_t capacity) : cells(round_up(capacity)), mask{cells.size()-1} {
+      for (size_t i = 0; i < cells.size(); ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      enqueue_pos.store(0, std::memory_order_relaxed);
+      dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator = (const MPMCQueue&) = delete;
+
+    // push an item if there is room, returns false if the queue is full,
+    // in which case data is left untouched
+    template <typename U>
+    bool try_push(U&& data) {
+      Cell* cell;
+      size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+      while(true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (dif == 0) {
+          if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (dif < 0) {
+          return false;
+        }
+        else {
+          pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      cell->data = std::forward<U>(data);
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    // pop an item into data, returns false if the queue is empty
+    bool try_pop(T& data) {
+      Cell* cell;
+      size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+      while(true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (dif == 0) {
+          if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (dif < 0) {
+          return false;
+        }
+        else {
+          pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      data = std::move(cell->data);
+      cell->sequence.store(pos + mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    // approximate: a producer that has claimed a cell counts as non-empty
+    bool empty() const {
+      return enqueue_pos.load(std::memory_order_relaxed) ==
+             dequeue_pos.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return cells.size(); }
+
+  private:
+
+    static size_t round_up(size_t n) {
+      size_t c = 2;
+      while (c < n) {
+        c <<= 1;
+      }
+      return c;
+    }
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// define THREADPOOL_STATS=1 (cmake -DTHREADPOOL_STATS=ON) to record the
+// per-worker counters; by default they are compiled away
+#ifndef THREADPOOL_STATS
+#define THREADPOOL_STATS 0
+#endif
+
+// ----------------------------------------------------------------------------
+// Snapshot of the per-worker counters of a pool
+// ----------------------------------------------------------------------------
+
+struct WorkerStats {
+  uint64_t tasks {0};            // tasks executed
+  uint64_t busy_ns {0};          // time spent running tasks
+  uint64_t idle_ns {0};          // time spent spinning or parked
+  uint64_t wakeups {0};          // times woken up after parking
+  uint64_t steals {0};           // tasks taken from another worker
+  uint64_t max_queue_depth {0};  // deepest queue seen when taking a task
+};
+
+struct PoolStats {
+
+  std::vector<WorkerStats> workers;
+
+  // sum over all workers (max for the queue depth)
+  WorkerStats total() const {
+    WorkerStats t;
+    for (auto& w : workers) {
+      t.tasks   += w.tasks;
+      t.busy_ns += w.busy_ns;
+      t.idle_ns += w.idle_ns;
+      t.wakeups += w.wakeups;
+      t.steals  += w.steals;
+      t.max_queue_depth = std::max(t.max_queue_depth, w.max_queue_depth);
+    }
+    return t;
+  }
+
+  std::string to_json() const {
+    std::ostringstream os;
+    os << "{\"workers\":[";
+    for (size_t i = 0; i < workers.size(); ++i) {
+      auto& w = workers[i];
+      os << (i ? "," : "")
+         << "{\"id\":" << i
+         << ",\"tasks\":" << w.tasks
+         << ",\"busy_ns\":" << w.busy_ns
+         << ",\"idle_ns\":" << w.idle_ns
+         << ",\"wakeups\":" << w.wakeups
+         << ",\"steals\":" << w.steals
+         << ",\"max_queue_depth\":" << w.max_queue_depth << "}";
+    }
+    os << "]}";
+    return os.str();
+  }
+
+  // Prometheus text exposition format, one sample per worker and metric
+  std::string to_prometheus(const std::string& prefix = "threadpool") const {
+    std::ostringstream os;
+    auto metric = [&](const char* name, const char* type, uint64_t WorkerStats::* field) {
+      os << "# TYPE " << prefix << "_" << name << " " << type << "\n";
+      for (size_t i = 0; i < workers.size(); ++i) {
+        os << prefix << "_" << name << "{worker=\"" << i << "\"} " << workers[i].*field << "\n";
+      }
+    };
+    metric("tasks_total",     "counter", &WorkerStats::tasks);
+    metric("busy_ns_total",   "counter", &WorkerStats::busy_ns);
+    metric("idle_ns_total",   "counter", &WorkerStats::idle_ns);
+    metric("wakeups_total",   "counter", &WorkerStats::wakeups);
+    metric("steals_total",    "counter", &WorkerStats::steals);
+    metric("max_queue_depth", "gauge",   &WorkerStats::max_queue_depth);
+    return os.str();
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Class definition for StatsRecorder
+// Every worker owns a cache-line-padded slot and is its only writer, so
+// recording is a relaxed load and store without contention; stats() may
+// read the slots at any time. StatsRecorder<false> has no state and all
+// of its calls compile to nothing.
+// ----------------------------------------------------------------------------
+
+template <bool Enabled = THREADPOOL_STATS>
+class StatsRecorder {
+
+  using clock = std::chrono::steady_clock;
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> tasks {0};
+    std::atomic<uint64_t> busy_ns {0};
+    std::atomic<uint64_t> idle_ns {0};
+    std::atomic<uint64_t> wakeups {0};
+    std::atomic<uint64_t> steals {0};
+    std::atomic<uint64_t> max_queue_depth {0};
+  };
+
+  public:
+
+    explicit StatsRecorder(size_t N) : slots(N) {}
+
+    // timestamp to pass to task_done or idle_done
+    static uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock::now().time_since_epoch()
+      ).count();
+    }
+
+    void task_done(size_t w, uint64_t since) {
+      add(slots[w].tasks, 1);
+      add(slots[w].busy_ns, now() - since);
+    }
+
+    void idle_done(size_t w, uint64_t since) {
+      add(slots[w].idle_ns, now() - since);
+    }
+
+    void wakeup(size_t w) {
+      add(slots[w].wakeups, 1);
+    }
+
+    void steal(size_t w) {
+      add(slots[w].steals, 1);
+    }
+
+    // depth() is only evaluated when the counters are compiled in
+    template <typename D>
+    void queue_depth(size_t w, D&& depth) {
+      uint64_t d = depth();
+      if(d > slots[w].max_queue_depth.load(std::memory_order_relaxed)) {
+        slots[w].max_queue_depth.store(d, std::memory_order_relaxed);
+      }
+    }
+
+    PoolStats snapshot() const {
+      PoolStats s;
+      s.workers.reserve(slots.size());
+      for (auto& slot : slots) {
+        WorkerStats w;
+        w.tasks           = slot.tasks.load(std::memory_order_relaxed);
+        w.busy_ns         = slot.busy_ns.load(std::memory_order_relaxed);
+        w.idle_ns         = slot.idle_ns.load(std::memory_order_relaxed);
+        w.wakeups         = slot.wakeups.load(std::memory_order_relaxed);
+        w.steals          = slot.steals.load(std::memory_order_relaxed);
+        w.max_queue_depth = slot.max_queue_depth.load(std::memory_order_relaxed);
+        s.workers.push_back(w);
+      }
+      return s;
+    }
+
+  private:
+
+    // single writer per slot: no read-modify-write needed
+    static void add(std::atomic<uint64_t>& c, uint64_t n) {
+      c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::vector<Slot> slots;
+};
+
+template <>
+class StatsRecorder<false> {
+
+  public:
+
+    explicit StatsRecorder(size_t) {}
+
+    static constexpr uint64_t now() { return 0; }
+
+    void task_done(size_t, uint64_t) {}
+
+    void idle_done(size_t, uint64_t) {}
+
+    void wakeup(size_t) {}
+
+    void steal(size_t) {}
+
+    template <typename D>
+    void queue_depth(size_t, D&&) {}
+
+    PoolStats snapshot() const { return {}; }
+};
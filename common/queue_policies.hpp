@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <vector>
+#include "work_stealing_queue.hpp"
+
+// ----------------------------------------------------------------------------
+// Queue policies of BasicThreadpool
+// A queue policy stores the tasks of a pool with N workers and does its
+// own synchronization; the pool only parks and wakes up the workers.
+//   QueuePolicy<T>(size_t N)
+//   size_t push(size_t self, T&& task)  self is the inserting worker (N if
+//                                       the caller is not a worker), returns
+//                                       the worker to wake up (N = any)
+//   bool pop(size_t i, T& task,         i is the worker (N for a caller
+//            bool* stolen = nullptr)    helping from outside); stolen is
+//                                       set if the task was stolen
+//   bool has_work(size_t i) const       whether pop(i) may succeed
+//   size_t depth(size_t i) const        number of tasks waiting for i
+// ----------------------------------------------------------------------------
+
+// one queue shared by all workers
+template <typename T>
+class CentralizedQueue {
+
+  public:
+
+    explicit CentralizedQueue(size_t N) : number_threads{N} {}
+
+    size_t push(size_t, T&& task) {
+      std::scoped_lock lock(mtx);
+      queue.push(std::move(task));
+      queued.store(queue.size(), std::memory_order_relaxed);
+      return number_threads;
+    }
+
+    bool pop(size_t, T& task, bool* = nullptr) {
+      if(queued.load(std::memory_order_relaxed) == 0) {
+        return false;
+      }
+      std::scoped_lock lock(mtx);
+      if(queue.empty()) {
+        return false;
+      }
+      task = std::move(queue.front());
+      queue.pop();
+      queued.store(queue.size(), std::memory_order_relaxed);
+      return true;
+    }
+
+    bool has_work(size_t) const {
+      return queued.load(std::memory_order_relaxed) > 0;
+    }
+
+    size_t depth(size_t) const {
+      return queued.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    size_t number_threads;
+    std::mutex mtx;
+    std::queue<T> queue;
+    std::atomic<size_t> queued {0};
+};
+
+// one queue per worker, filled in a round robin manner; a worker only
+// runs the tasks of its own queue
+template <typename T>
+class RoundRobinQueues {
+
+  struct alignas(64) Slot {
+    std::mutex mtx;
+    std::queue<T> queue;
+    std::atomic<size_t> size {0};
+  };
+
+  public:
+
+    explicit RoundRobinQueues(size_t N) : slots(N) {}
+
+    size_t push(size_t, T&& task) {
+      size_t q = turn.fetch_add(1, std::memory_order_relaxed)%slots.size();
+      std::scoped_lock lock(slots[q].mtx);
+      slots[q].queue.push(std::move(task));
+      slots[q].size.store(slots[q].queue.size(), std::memory_order_relaxed);
+      return q;
+    }
+
+    bool pop(size_t i, T& task, bool* = nullptr) {
+      if(i < slots.size()) {
+        return pop_from(i, task);
+      }
+      // a helping caller takes from any queue
+      for (size_t q = 0; q < slots.size(); ++q) {
+        if(pop_from(q, task)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool has_work(size_t i) const {
+      if(i < slots.size()) {
+        return slots[i].size.load(std::memory_order_relaxed) > 0;
+      }
+      for (auto& s : slots) {
+        if(s.size.load(std::memory_order_relaxed) > 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    size_t depth(size_t i) const {
+      return i < slots.size() ? slots[i].size.load(std::memory_order_relaxed) : 0;
+    }
+
+  private:
+
+    bool pop_from(size_t q, T& task) {
+      if(slots[q].size.load(std::memory_order_relaxed) == 0) {
+        return false;
+      }
+      std::scoped_lock lock(slots[q].mtx);
+      if(slots[q].queue.empty()) {
+        return false;
+      }
+      task = std::move(slots[q].queue.front());
+      slots[q].queue.pop();
+      slots[q].size.store(slots[q].queue.size(), std::memory_order_relaxed);
+      return true;
+    }
+
+    std::vector<Slot> slots;
+    std::atomic<size_t> turn {0};
+};
+
+// one Chase-Lev deque per worker plus a shared queue for the tasks that
+// are inserted from outside; a worker pushes to and pops from its own
+// deque and steals from random victims when it runs dry
+template <typename T>
+class WorkStealingQueues {
+
+  public:
+
+    explicit WorkStealingQueues(size_t N) : deques(N) {}
+
+    ~WorkStealingQueues() {
+      T* task {nullptr};
+      for (auto& d : deques) {
+        while((task = d.pop())) {
+          delete task;
+        }
+      }
+      while(!shared.empty()) {
+        delete shared.front();
+        shared.pop();
+      }
+    }
+
+    size_t push(size_t self, T&& task) {
+      T* t = new T(std::move(task));
+      if(self < deques.size()) {
+        deques[self].push(t);
+      }
+      else {
+        std::scoped_lock lock(mtx);
+        shared.push(t);
+        queued.store(shared.size(), std::memory_order_relaxed);
+      }
+      return deques.size();
+    }
+
+    bool pop(size_t i, T& task, bool* stolen = nullptr) {
+      T* t {nullptr};
+      if(i < deques.size()) {
+        t = deques[i].pop();
+      }
+      if(!t && queued.load(std::memory_order_relaxed) > 0) {
+        std::scoped_lock lock(mtx);
+        if(!shared.empty()) {
+          t = shared.front();
+          shared.pop();
+          queued.store(shared.size(), std::memory_order_relaxed);
+        }
+      }
+      if(!t && (t = steal(i)) && stolen) {
+        *stolen = true;
+      }
+      if(!t) {
+        return false;
+      }
+      task = std::move(*t);
+      delete t;
+      return true;
+    }
+
+    bool has_work(size_t) const {
+      if(queued.load(std::memory_order_relaxed) > 0) {
+        return true;
+      }
+      for (auto& d : deques) {
+        if(!d.empty()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    size_t depth(size_t i) const {
+      return (i < deques.size() ? deques[i].size() : 0) + queued.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    // try a few random victims, then all of them in order
+    T* steal(size_t i) {
+      thread_local std::mt19937 rng{std::random_device{}()};
+      size_t N = deques.size();
+      std::uniform_int_distribution<size_t> dist(0, N-1);
+      for (size_t r = 0; r < N; ++r) {
+        size_t v = dist(rng);
+        if(v == i) {
+          continue;
+        }
+        if(T* t = deques[v].steal(); t) {
+          return t;
+        }
+      }
+      for (size_t v = 0; v < N; ++v) {
+        if(v == i) {
+          continue;
+        }
+        if(T* t = deques[v].steal(); t) {
+          return t;
+        }
+      }
+      return nullptr;
+    }
+
+    std::vector<WorkStealingQueue<T*>> deques;
+    std::mutex mtx;
+    std::queue<T*> shared;
+    std::atomic<size_t> queued {0};
+};
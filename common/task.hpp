@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <future>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "task_group.hpp"
+
+// priority levels of a task, most urgent first
+enum class Priority : size_t {
+  HIGH,
+  NORMAL,
+  LOW
+};
+
+inline constexpr size_t num_priorities = 3;
+
+// ----------------------------------------------------------------------------
+// Class definition for a move-only task
+// Callables that fit in the inline buffer (and are nothrow movable) are
+// stored in place, so submitting them costs no heap allocation; larger
+// ones fall back to a single heap allocation
+// ----------------------------------------------------------------------------
+
+class Task {
+
+  struct VTable {
+    void (*invoke)(void*);
+    void (*move)(void* dst, void* src);   // move-construct dst from src and destroy src
+    void (*destroy)(void*);
+  };
+
+  public:
+
+    // size of the inline capture buffer in bytes
+    static constexpr size_t capacity = 64;
+
+    Task() = default;
+
+    template <typename C,
+      std::enable_if_t<!std::is_same_v<std::decay_t<C>, Task>, int> = 0
+    >
+    Task(C&& callable) {
+      using F = std::decay_t<C>;
+      if constexpr (fits_inline<F>) {
+        new (storage) F(std::forward<C>(callable));
+        vtable = &inline_vtable<F>;
+      }
+      else {
+        *reinterpret_cast<F**>(storage) = new F(std::forward<C>(callable));
+        vtable = &heap_vtable<F>;
+      }
+    }
+
+    Task(Task&& rhs) noexcept : vtable{rhs.vtable} {
+      if (vtable) {
+        vtable->move(storage, rhs.storage);
+        rhs.vtable = nullptr;
+      }
+    }
+
+    Task& operator = (Task&& rhs) noexcept {
+      if (this != &rhs) {
+        reset();
+        if (rhs.vtable) {
+          rhs.vtable->move(storage, rhs.storage);
+          vtable = rhs.vtable;
+          rhs.vtable = nullptr;
+        }
+      }
+      return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator = (const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const { return vtable != nullptr; }
+
+    void operator()() { vtable->invoke(storage); }
+
+    // destroy the stored callable, leaving the task empty
+    void reset() {
+      if (vtable) {
+        vtable->destroy(storage);
+        vtable = nullptr;
+      }
+    }
+
+  private:
+
+    template <typename F>
+    static constexpr bool fits_inline = sizeof(F) <= capacity &&
+                                        alignof(F) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F>
+    inline static const VTable inline_vtable = {
+      [](void* p) { (*static_cast<F*>(p))(); },
+      [](void* dst, void* src) {
+        new (dst) F(std::move(*static_cast<F*>(src)));
+        static_cast<F*>(src)->~F();
+      },
+      [](void* p) { static_cast<F*>(p)->~F(); }
+    };
+
+    template <typename F>
+    inline static const VTable heap_vtable = {
+      [](void* p) { (**static_cast<F**>(p))(); },
+      [](void* dst, void* src) { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+      [](void* p) { delete *static_cast<F**>(p); }
+    };
+
+    alignas(std::max_align_t) unsigned char storage[capacity];
+    const VTable* vtable {nullptr};
+};
+
+
+// ----------------------------------------------------------------------------
+// Shared state of the n tasks created by insert_range
+// Every task only carries a pointer to this state and its index; the last
+// task to finish either fulfills the promise or marks the task group it
+// was attached to as done, and releases the state
+// ----------------------------------------------------------------------------
+
+template <typename F>
+struct RangeState {
+
+  template <typename C>
+  RangeState(size_t n, C&& callable, TaskGroup* g = nullptr) :
+    remaining{n}, group{g}, fn{std::forward<C>(callable)} {
+    if (group) {
+      group->add();
+    }
+  }
+
+  void run(size_t i) {
+    fn(i);
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      finish();
+    }
+  }
+
+  // also called directly for an empty range
+  void finish() {
+    TaskGroup* g = group;
+    if (!g) {
+      promise.set_value();
+    }
+    delete this;
+    if (g) {
+      g->done();
+    }
+  }
+
+  std::atomic<size_t> remaining;
+  TaskGroup* group;
+  std::promise<void> promise;
+  F fn;
+};
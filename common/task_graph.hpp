@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "task.hpp"
+#include "task_group.hpp"
+
+// ----------------------------------------------------------------------------
+// Class definition for TaskGraph
+// A TaskGraph is a DAG of tasks with precedence edges. Running it on a pool
+// only submits the nodes without dependencies; every other node is
+// submitted by the last of its predecessors to finish, so dependent stages
+// overlap instead of meeting at a barrier. The graph can be run again once
+// a run has finished, but the edges must not form a cycle.
+// ----------------------------------------------------------------------------
+
+class TaskGraph {
+
+  public:
+
+    class Node {
+
+      friend class TaskGraph;
+
+      public:
+
+        // this node has to finish before the given node can start
+        Node& precede(Node& node) {
+          successors.push_back(&node);
+          ++node.dependencies;
+          return *this;
+        }
+
+        // the given node has to finish before this node can start
+        Node& succeed(Node& node) {
+          node.precede(*this);
+          return *this;
+        }
+
+      private:
+
+        Task work;
+        std::vector<Node*> successors;
+        size_t dependencies {0};
+        std::atomic<size_t> pending {0};
+    };
+
+    TaskGraph() = default;
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator = (const TaskGraph&) = delete;
+
+    // add a node running the given callable
+    template <typename C>
+    Node& emplace(C&& callable) {
+      Node& node = emplace();
+      node.work = Task(std::forward<C>(callable));
+      return node;
+    }
+
+    // add an empty node, e.g. to join many nodes into one edge
+    Node& emplace() {
+      nodes.push_back(std::make_unique<Node>());
+      return *nodes.back();
+    }
+
+    size_t size() const {
+      return nodes.size();
+    }
+
+    bool empty() const {
+      return nodes.empty();
+    }
+
+    // submit the graph to the pool and attach all its nodes to the group;
+    // the graph must stay alive until the group is done
+    template <typename Pool>
+    void run(Pool& pool, TaskGroup& group) {
+
+      if (nodes.empty()) {
+        return;
+      }
+
+      // reset the counters before any node can run
+      std::vector<Node*> sources;
+      for (auto& node : nodes) {
+        node->pending.store(node->dependencies, std::memory_order_relaxed);
+        if (node->dependencies == 0) {
+          sources.push_back(node.get());
+        }
+      }
+
+      group.add(nodes.size());
+      for (Node* node : sources) {
+        schedule(pool, group, node);
+      }
+    }
+
+    // submit the graph and wait until all nodes have finished
+    template <typename Pool>
+    void run_and_wait(Pool& pool) {
+      TaskGroup group;
+      run(pool, group);
+      pool.wait(group);
+    }
+
+  private:
+
+    template <typename Pool>
+    static void schedule(Pool& pool, TaskGroup& group, Node* node) {
+      pool.silent_insert([&pool, &group, node](){
+        execute(pool, group, node);
+      });
+    }
+
+    // run a node and release its successors; one successor that becomes
+    // ready is run right here instead of making a round trip through the
+    // pool's queue
+    template <typename Pool>
+    static void execute(Pool& pool, TaskGroup& group, Node* node) {
+      while (node) {
+        if (node->work) {
+          node->work();
+        }
+        Node* next = nullptr;
+        for (Node* successor : node->successors) {
+          if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (next) {
+              schedule(pool, group, next);
+            }
+            next = successor;
+          }
+        }
+        // the graph may be gone once the last node is done
+        group.done();
+        node = next;
+      }
+    }
+
+    std::vector<std::unique_ptr<Node>> nodes;
+};
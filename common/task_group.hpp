@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------------
+// Class definition for TaskGroup
+// A TaskGroup counts outstanding tasks with a single atomic counter, so
+// the caller can wait for all of them at once instead of one future each
+// ----------------------------------------------------------------------------
+
+class TaskGroup {
+
+  public:
+
+    TaskGroup() = default;
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator = (const TaskGroup&) = delete;
+
+    // register n more outstanding tasks
+    void add(size_t n = 1) {
+      pending.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // mark one task as finished
+    void done() {
+      // all but the last decrement are lock-free
+      size_t p = pending.load(std::memory_order_relaxed);
+      while (p > 1) {
+        if (pending.compare_exchange_weak(p, p-1, std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed)) {
+          return;
+        }
+      }
+      // the counter may only reach zero under the lock, otherwise wait()
+      // could return and destroy the group before we notify it
+      std::scoped_lock lock(mtx);
+      if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        cv.notify_all();
+      }
+    }
+
+    // block until all tasks added so far have finished
+    void wait() {
+      std::unique_lock lock(mtx);
+      cv.wait(lock, [this](){ return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // number of outstanding tasks
+    size_t size() const {
+      return pending.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    std::atomic<size_t> pending {0};
+    std::mutex mtx;
+    std::condition_variable cv;
+};
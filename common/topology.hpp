@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <tuple>
+#include <cctype>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// CPU topology and worker placement
+// The topology is read from /sys/devices/system/cpu; where it is not
+// available, every logical cpu is treated as its own core on node 0
+// ----------------------------------------------------------------------------
+
+// how workers are pinned to cpus
+enum class Placement {
+  NONE,            // leave placement to the OS scheduler
+  COMPACT,         // fill up a core (all of its hyperthreads), then the next
+                   // core of the same node
+  SCATTER,         // spread workers round-robin over the nodes and their cores
+  PHYSICAL_CORES   // at most one worker per physical core
+};
+
+struct CpuInfo {
+  int cpu;       // logical cpu id
+  int core;      // core id within the package
+  int package;   // socket
+  int node;      // NUMA node
+};
+
+namespace topology {
+
+// parse a cpu list such as "0-3,8,10-11"
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int beg = std::stoi(range.substr(0, dash));
+    int end = dash == std::string::npos ? beg : std::stoi(range.substr(dash + 1));
+    for (int c = beg; c <= end; ++c) {
+      cpus.push_back(c);
+    }
+  }
+  return cpus;
+}
+
+inline int read_int(const std::string& path, int fallback) {
+  std::ifstream ifs(path);
+  int value;
+  return (ifs >> value) ? value : fallback;
+}
+
+// logical cpus of this machine sorted by (node, package, core, cpu)
+inline std::vector<CpuInfo> cpus() {
+
+  namespace fs = std::filesystem;
+
+  const std::string root = "/sys/devices/system/cpu/";
+
+  std::vector<int> online;
+  if (std::ifstream ifs(root + "online"); ifs) {
+    std::string list;
+    std::getline(ifs, list);
+    online = parse_cpu_list(list);
+  }
+  if (online.empty()) {
+    for (int c = 0; c < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++c) {
+      online.push_back(c);
+    }
+  }
+
+  std::vector<CpuInfo> infos;
+  for (int c : online) {
+    std::string dir = root + "cpu" + std::to_string(c) + "/";
+    CpuInfo info {c, c, 0, 0};
+    info.core    = read_int(dir + "topology/core_id", c);
+    info.package = read_int(dir + "topology/physical_package_id", 0);
+    // the node shows up as a nodeX entry in the cpu directory
+    std::error_code ec;
+    for (auto& entry : fs::directory_iterator(dir, ec)) {
+      auto name = entry.path().filename().string();
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+        info.node = std::stoi(name.substr(4));
+        break;
+      }
+    }
+    infos.push_back(info);
+  }
+
+  std::sort(infos.begin(), infos.end(), [](const CpuInfo& a, const CpuInfo& b){
+    return std::tie(a.node, a.package, a.core, a.cpu) <
+           std::tie(b.node, b.package, b.core, b.cpu);
+  });
+
+  return infos;
+}
+
+// the cpus to pin N workers to under the given placement, cycling
+// through them if there are more workers than cpus; empty for NONE
+// all must be sorted as returned by cpus()
+inline std::vector<CpuInfo> place(Placement placement, size_t N,
+                                  const std::vector<CpuInfo>& all = cpus()) {
+
+  if (placement == Placement::NONE || N == 0 || all.empty()) {
+    return {};
+  }
+
+  std::vector<CpuInfo> order;
+
+  switch (placement) {
+
+    case Placement::COMPACT:
+      order = all;
+    break;
+
+    case Placement::PHYSICAL_CORES:
+      for (auto& c : all) {
+        if (order.empty() || order.back().node != c.node ||
+            order.back().package != c.package || order.back().core != c.core) {
+          order.push_back(c);
+        }
+      }
+    break;
+
+    case Placement::SCATTER: {
+      // first hyperthread of every core on every node, then the second...
+      std::vector<std::vector<CpuInfo>> nodes;
+      std::vector<CpuInfo> firsts, rests;
+      for (size_t i = 0; i < all.size(); ++i) {
+        bool first = i == 0 || all[i-1].node != all[i].node ||
+                     all[i-1].package != all[i].package || all[i-1].core != all[i].core;
+        (first ? firsts : rests).push_back(all[i]);
+      }
+      for (auto* part : {&firsts, &rests}) {
+        nodes.clear();
+        for (auto& c : *part) {
+          if (nodes.empty() || nodes.back().front().node != c.node) {
+            nodes.emplace_back();
+          }
+          nodes.back().push_back(c);
+        }
+        // interleave the nodes
+        for (size_t k = 0; ; ++k) {
+          bool any = false;
+          for (auto& n : nodes) {
+            if (k < n.size()) {
+              order.push_back(n[k]);
+              any = true;
+            }
+          }
+          if (!any) {
+            break;
+          }
+        }
+      }
+    }
+    break;
+
+    default:
+    break;
+  }
+
+  std::vector<CpuInfo> placed(N);
+  for (size_t i = 0; i < N; ++i) {
+    placed[i] = order[i % order.size()];
+  }
+  return placed;
+}
+
+// pin a thread to one cpu, returns false if the platform refused
+inline bool pin(std::thread& t, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &set) == 0;
+#else
+  (void)t;
+  (void)cpu;
+  return false;
+#endif
+}
+
+}  // end of namespace topology
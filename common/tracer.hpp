@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Class definition for Tracer
+// A process-wide timeline of task executions in the Chrome trace_event
+// format (open it in Perfetto or chrome://tracing). While tracing is on,
+// every task a pool runs is recorded with its start and end time into a
+// buffer owned by the running thread, so recording takes no lock; the
+// buffers are written out by stop() or, if tracing is still on, at exit.
+// ----------------------------------------------------------------------------
+
+class Tracer {
+
+  struct Event {
+    const char* label;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  struct Buffer {
+    size_t tid;
+    long worker;
+    std::vector<Event> events;
+  };
+
+  public:
+
+    // start recording; the trace is written to path when it stops
+    static void start(std::string path = "trace.json") {
+      Tracer& t = instance();
+      std::scoped_lock lock(t.mtx);
+      t.path = std::move(path);
+      t.origin = now();
+      t.on.store(true, std::memory_order_release);
+    }
+
+    // stop recording and write the trace; the pools must not run tasks
+    // any more, i.e. they have been shut down and joined
+    static bool stop() {
+      Tracer& t = instance();
+      if(!t.on.exchange(false)) {
+        return false;
+      }
+      return t.write();
+    }
+
+    static bool enabled() {
+      return instance().on.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+      ).count();
+    }
+
+    // name the calling thread "worker id" in the trace
+    static void set_worker(size_t id) {
+      worker = static_cast<long>(id);
+    }
+
+    // label of the task running on the calling thread, see labeled()
+    static void set_label(const char* label) {
+      current_label = label;
+    }
+
+    static const char* exchange_label(const char* label) {
+      return std::exchange(current_label, label);
+    }
+
+    static void record(const char* label, uint64_t start, uint64_t end) {
+      buffer().events.push_back({label ? label : "task", start, end});
+    }
+
+  private:
+
+    Tracer() = default;
+
+    ~Tracer() {
+      if(on.load()) {
+        write();
+      }
+    }
+
+    static Tracer& instance() {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    // the buffer of the calling thread, created on its first event
+    static Buffer& buffer() {
+      if(!local) {
+        Tracer& t = instance();
+        std::scoped_lock lock(t.mtx);
+        t.buffers.push_back(std::make_unique<Buffer>(Buffer{t.buffers.size(), worker, {}}));
+        local = t.buffers.back().get();
+        local->events.reserve(1024);
+      }
+      return *local;
+    }
+
+    bool write() {
+      std::scoped_lock lock(mtx);
+      std::ofstream os(path);
+      if(!os) {
+        return false;
+      }
+      os << "{\"traceEvents\":[";
+      bool first = true;
+      for (auto& b : buffers) {
+        os << (first ? "" : ",")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << b->tid
+           << ",\"args\":{\"name\":\""
+           << (b->worker < 0 ? "thread " + std::to_string(b->tid) : "worker " + std::to_string(b->worker))
+           << "\"}}";
+        first = false;
+        for (auto& e : b->events) {
+          if(e.start < origin) {
+            continue;
+          }
+          // timestamps are in microseconds
+          os << ",{\"name\":\"" << escape(e.label) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << b->tid
+             << ",\"ts\":" << (e.start - origin) / 1e3
+             << ",\"dur\":" << (e.end - e.start) / 1e3 << "}";
+        }
+      }
+      os << "],\"displayTimeUnit\":\"ns\"}\n";
+      return static_cast<bool>(os);
+    }
+
+    static std::string escape(const char* label) {
+      std::string s;
+      for (; *label; ++label) {
+        if(*label == '"' || *label == '\\') {
+          s += '\\';
+        }
+        s += *label;
+      }
+      return s;
+    }
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::atomic<bool> on {false};
+    std::string path;
+    uint64_t origin {0};
+
+    inline static thread_local Buffer* local {nullptr};
+    inline static thread_local const char* current_label {nullptr};
+    inline static thread_local long worker {-1};
+};
+
+// a callable that names its task in the trace, e.g.
+//   threadpool.insert(group, labeled("block", [&](){ ... }));
+template <typename C>
+struct Labeled {
+
+  void operator()() {
+    Tracer::set_label(label);
+    fn();
+  }
+
+  const char* label;
+  C fn;
+};
+
+template <typename C>
+Labeled<std::decay_t<C>> labeled(const char* label, C&& fn) {
+  return {label, std::forward<C>(fn)};
+}
+
+// run a task of a pool, recording it if tracing is on; the label set by
+// the task (if any) is taken and the one of an enclosing task restored
+template <typename F>
+void run_traced(F&& task) {
+  if(!Tracer::enabled()) {
+    task();
+    return;
+  }
+  const char* outer = Tracer::exchange_label(nullptr);
+  uint64_t start = Tracer::now();
+  task();
+  uint64_t end = Tracer::now();
+  Tracer::record(Tracer::exchange_label(outer), start, end);
+}
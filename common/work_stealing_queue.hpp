@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// ----------------------------------------------------------------------------
+// Class definition for a lock-free work-stealing deque (Chase-Lev)
+// Only the owner thread may push and pop at the bottom, while any other
+// thread may steal from the top. T must be a pointer type.
+// ----------------------------------------------------------------------------
+
+template <typename T>
+class WorkStealingQueue {
+
+  struct Array {
+
+    int64_t C;
+    int64_t M;
+    std::atomic<T>* S;
+
+    explicit Array(int64_t c) : C{c}, M{c-1}, S{new std::atomic<T>[static_cast<size_t>(c)]} {}
+
+    ~Array() { delete [] S; }
+
+    int64_t capacity() const { return C; }
+
+    void push(int64_t i, T o) { S[i & M].store(o, std::memory_order_relaxed); }
+
+    T pop(int64_t i) { return S[i & M].load(std::memory_order_relaxed); }
+
+    // grow the ring buffer to twice of its size, copying [t, b)
+    Array* resize(int64_t b, int64_t t) {
+      Array* ptr = new Array{2*C};
+      for (int64_t i = t; i != b; ++i) {
+        ptr->push(i, pop(i));
+      }
+      return ptr;
+    }
+  };
+
+  public:
+
+    // capacity must be a power of two
+    explicit WorkStealingQueue(int64_t capacity = 1024) {
+      top.store(0, std::memory_order_relaxed);
+      bottom.store(0, std::memory_order_relaxed);
+      array.store(new Array{capacity}, std::memory_order_relaxed);
+      garbage.reserve(32);
+    }
+
+    ~WorkStealingQueue() {
+      for (auto a : garbage) {
+        delete a;
+      }
+      delete array.load();
+    }
+
+    bool empty() const {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_relaxed);
+      return b <= t;
+    }
+
+    size_t size() const {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_relaxed);
+      return static_cast<size_t>(b >= t ? b - t : 0);
+    }
+
+    // push an item to the bottom (owner only)
+    void push(T o) {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_acquire);
+      Array* a = array.load(std::memory_order_relaxed);
+
+      // queue is full
+      if (a->capacity() - 1 < (b - t)) {
+        Array* tmp = a->resize(b, t);
+        garbage.push_back(a);
+        std::swap(a, tmp);
+        array.store(a, std::memory_order_release);
+      }
+
+      a->push(b, o);
+      bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // pop an item from the bottom (owner only), or nullptr if empty
+    T pop() {
+      int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+      Array* a = array.load(std::memory_order_relaxed);
+      bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t t = top.load(std::memory_order_relaxed);
+
+      T item {nullptr};
+
+      if (t <= b) {
+        item = a->pop(b);
+        // the last item races with thieves
+        if (t == b) {
+          if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed)) {
+            item = nullptr;
+          }
+          bottom.store(b + 1, std::memory_order_relaxed);
+        }
+      }
+      else {
+        bottom.store(b + 1, std::memory_order_relaxed);
+      }
+
+      return item;
+    }
+
+    // steal an item from the top (any thread), or nullptr if empty or lost the race
+    T steal() {
+      int64_t t = top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t b = bottom.load(std::memory_order_acquire);
+
+      T item {nullptr};
+
+      if (t < b) {
+        Array* a = array.load(std::memory_order_acquire);
+        item = a->pop(t);
+        if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed)) {
+          return nullptr;
+        }
+      }
+
+      return item;
+    }
+
+  private:
+
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<Array*> array;
+    std::vector<Array*> garbage;
+};